@@ -0,0 +1,256 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Rng.h"
+#include "Vec3.h"
+
+// ------------------ Trail -------------------
+// Every trail lives in one arena: a fixed-length ring buffer slot per ball,
+// indexed by head/count. Slots are allocated when balls are added, so
+// recording a point never allocates. With interval 0 nothing is recorded and
+// the arena is never allocated; every trail stays empty.
+struct TrailStore {
+    static constexpr int length = 30;
+
+    int interval = 1;          // record a trail point every k steps; 0 = off
+    bool quantized = false;    // store points as 16-bit fixed point relative to range
+    float range = 10.0f;       // half-extent covered by quantized points (the box size)
+
+    std::vector<Vec3> points;      // full precision, length per slot
+    std::vector<int16_t> packed;   // quantized x/y/z, 3 * length per slot
+    std::vector<uint8_t> head;     // next write position in each slot
+    std::vector<uint8_t> count;    // points stored in each slot
+    int stepCounter = 0;
+
+    size_t size() const { return head.size(); }
+    bool enabled() const { return interval > 0; }
+
+    // Must be called while the store is empty
+    void configure(int everyK, bool quantize, float boxSize) {
+        interval = std::max(0, everyK);
+        quantized = quantize;
+        range = boxSize;
+    }
+
+    // Arena values per slot: quantized points take three int16s, full ones one Vec3
+    size_t slotValues() const { return enabled() ? (quantized ? length * 3 : length) : 0; }
+
+    void reserve(size_t n) {
+        if (quantized)
+            packed.reserve(n * slotValues());
+        else
+            points.reserve(n * slotValues());
+        head.reserve(n);
+        count.reserve(n);
+    }
+
+    void addSlot() { addSlots(1); }
+
+    void addSlots(size_t n) {
+        if (quantized)
+            packed.resize(packed.size() + n * slotValues());
+        else
+            points.resize(points.size() + n * slotValues());
+        head.resize(head.size() + n, 0);
+        count.resize(count.size() + n, 0);
+    }
+
+    // Swap-remove, mirroring BallSystem::remove
+    void removeSlot(size_t i) {
+        size_t last = size() - 1;
+        size_t k = slotValues();
+        if (i != last) {
+            if (quantized)
+                std::copy(packed.begin() + last * k, packed.begin() + (last + 1) * k, packed.begin() + i * k);
+            else
+                std::copy(points.begin() + last * k, points.begin() + (last + 1) * k, points.begin() + i * k);
+            head[i] = head[last];
+            count[i] = count[last];
+        }
+        if (quantized)
+            packed.resize(last * k);
+        else
+            points.resize(last * k);
+        head.pop_back();
+        count.pop_back();
+    }
+
+    void clear() {
+        points.clear();
+        packed.clear();
+        head.clear();
+        count.clear();
+    }
+
+    int16_t quantize(float v) const {
+        float q = v / range * 32767.0f;
+        q = std::max(-32767.0f, std::min(32767.0f, q));
+        return static_cast<int16_t>(lroundf(q));
+    }
+
+    float dequantize(int16_t q) const { return q * range / 32767.0f; }
+
+    void store(size_t slot, int k, const Vec3& p) {
+        if (quantized) {
+            int16_t* q = &packed[(slot * length + k) * 3];
+            q[0] = quantize(p.x);
+            q[1] = quantize(p.y);
+            q[2] = quantize(p.z);
+        }
+        else {
+            points[slot * length + k] = p;
+        }
+    }
+
+    Vec3 load(size_t slot, int k) const {
+        if (quantized) {
+            const int16_t* q = &packed[(slot * length + k) * 3];
+            return Vec3(dequantize(q[0]), dequantize(q[1]), dequantize(q[2]));
+        }
+        return points[slot * length + k];
+    }
+
+    void add(size_t slot, const Vec3& pos) {
+        store(slot, head[slot], pos);
+        head[slot] = (head[slot] + 1) % length;
+        if (count[slot] < length)
+            ++count[slot];
+    }
+
+    // i-th stored point of a slot, oldest first
+    Vec3 point(size_t slot, int i) const {
+        int start = (head[slot] - count[slot] + length) % length;
+        return load(slot, (start + i) % length);
+    }
+};
+
+// ------------------ Ball -------------------
+// Description of a single ball, used when spawning; live balls are kept in BallSystem
+struct Ball {
+    Vec3 pos, vel;
+    float radius, mass;
+    float r, g, b;
+
+    Ball(Vec3 p, Vec3 v, float radius, RngStream& rng) : pos(p), vel(v), radius(radius) {
+        mass = radius * radius * radius;
+        r = rng.uniform();
+        g = rng.uniform();
+        b = rng.uniform();
+    }
+};
+
+struct Color {
+    float r, g, b;
+};
+
+// ------------------ Ball System -------------------
+// Structure-of-arrays ball storage. The integrator and the collision loop only
+// touch the hot arrays; colours and trails sit apart and are read when drawing.
+struct BallSystem {
+    // Hot data
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> radius, invMass;
+
+    // Sleep state: resting balls skip integration and narrow-phase tests
+    std::vector<uint8_t> sleeping;
+    std::vector<float> restTime;     // seconds spent below the sleep speed
+
+    // Stable identity for the contact cache; indices change on swap-remove
+    std::vector<uint32_t> id;
+    uint32_t nextId = 0;             // never reset, so a cleared system never reuses an id
+
+    // Bumped whenever balls are added or removed, so state saved by index can
+    // tell that its indices no longer name the same balls
+    uint64_t generation = 0;
+
+    // Cold data
+    std::vector<Color> color;
+    TrailStore trails;
+
+    size_t size() const { return px.size(); }
+    bool empty() const { return px.empty(); }
+
+    Vec3 position(size_t i) const { return Vec3(px[i], py[i], pz[i]); }
+    Vec3 velocity(size_t i) const { return Vec3(vx[i], vy[i], vz[i]); }
+    void setPosition(size_t i, const Vec3& p) { px[i] = p.x; py[i] = p.y; pz[i] = p.z; }
+    void setVelocity(size_t i, const Vec3& v) { vx[i] = v.x; vy[i] = v.y; vz[i] = v.z; }
+
+    void wake(size_t i) { sleeping[i] = 0; restTime[i] = 0; }
+
+    void reserve(size_t n) {
+        px.reserve(n); py.reserve(n); pz.reserve(n);
+        vx.reserve(n); vy.reserve(n); vz.reserve(n);
+        radius.reserve(n); invMass.reserve(n);
+        sleeping.reserve(n); restTime.reserve(n);
+        id.reserve(n);
+        color.reserve(n); trails.reserve(n);
+    }
+
+    void add(const Ball& b) {
+        px.push_back(b.pos.x); py.push_back(b.pos.y); pz.push_back(b.pos.z);
+        vx.push_back(b.vel.x); vy.push_back(b.vel.y); vz.push_back(b.vel.z);
+        radius.push_back(b.radius);
+        invMass.push_back(1.0f / b.mass);
+        sleeping.push_back(0);
+        restTime.push_back(0);
+        id.push_back(nextId++);
+        color.push_back({ b.r, b.g, b.b });
+        trails.addSlot();
+        ++generation;
+    }
+
+    // Appends n balls at the origin with unit mass and fresh ids, for bulk
+    // spawning; the caller fills in the arrays. Returns the first new index.
+    size_t grow(size_t n) {
+        size_t first = size();
+        px.resize(first + n); py.resize(first + n); pz.resize(first + n);
+        vx.resize(first + n); vy.resize(first + n); vz.resize(first + n);
+        radius.resize(first + n, 1.0f); invMass.resize(first + n, 1.0f);
+        sleeping.resize(first + n, 0); restTime.resize(first + n, 0.0f);
+        id.resize(first + n);
+        for (size_t i = first; i < first + n; ++i)
+            id[i] = nextId++;
+        color.resize(first + n);
+        trails.addSlots(n);
+        ++generation;
+        return first;
+    }
+
+    // Swap-remove: the last ball takes index i
+    void remove(size_t i) {
+        size_t last = size() - 1;
+        if (i != last) {
+            px[i] = px[last]; py[i] = py[last]; pz[i] = pz[last];
+            vx[i] = vx[last]; vy[i] = vy[last]; vz[i] = vz[last];
+            radius[i] = radius[last];
+            invMass[i] = invMass[last];
+            sleeping[i] = sleeping[last];
+            restTime[i] = restTime[last];
+            id[i] = id[last];
+            color[i] = color[last];
+        }
+        px.pop_back(); py.pop_back(); pz.pop_back();
+        vx.pop_back(); vy.pop_back(); vz.pop_back();
+        radius.pop_back(); invMass.pop_back();
+        sleeping.pop_back(); restTime.pop_back();
+        id.pop_back();
+        color.pop_back();
+        trails.removeSlot(i);
+        ++generation;
+    }
+
+    void clear() {
+        px.clear(); py.clear(); pz.clear();
+        vx.clear(); vy.clear(); vz.clear();
+        radius.clear(); invMass.clear();
+        sleeping.clear(); restTime.clear();
+        id.clear();
+        color.clear(); trails.clear();
+        ++generation;
+    }
+};
@@ -0,0 +1,352 @@
+﻿// Benchmark.cpp : Microbenchmarks for the physics hot paths.
+//
+// Every case runs at ball counts from 100 up to --max-balls with a fixed seed
+// and reports nanoseconds per step and per element as JSON. A case whose
+// per-element cost grows with N is flagged as superlinear. A full step is
+// also timed at 1, 2, 4, ... --max-threads threads to show strong scaling.
+// Barnes-Hut N-body gravity is timed against direct summation, and its
+// accuracy is measured against direct sums on a sample of bodies.
+//
+// Usage: gravity_bench [--max-balls N] [--max-threads N] [--min-time SECONDS] [--seed N] [--out FILE]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "World.h"
+
+// ------------------ Options -------------------
+struct Options {
+    size_t maxBalls = 1000000;
+    int maxThreads = 32;
+    double minTime = 0.2;     // seconds of timed work per measurement
+    unsigned seed = 1;
+    std::string out;          // empty = stdout
+};
+
+static bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "--max-balls") && hasValue)
+            opt.maxBalls = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(arg, "--max-threads") && hasValue)
+            opt.maxThreads = atoi(argv[++i]);
+        else if (!strcmp(arg, "--min-time") && hasValue)
+            opt.minTime = atof(argv[++i]);
+        else if (!strcmp(arg, "--seed") && hasValue)
+            opt.seed = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (!strcmp(arg, "--out") && hasValue)
+            opt.out = argv[++i];
+        else
+            return false;
+    }
+    return opt.maxBalls >= 100 && opt.maxThreads >= 1 && opt.minTime > 0;
+}
+
+// ------------------ Results -------------------
+struct Result {
+    std::string name, variant;
+    size_t elements;
+    long iterations;
+    double nsPerOp;
+    double nsPerElement() const { return elements ? nsPerOp / elements : 0; }
+};
+
+std::vector<Result> results;
+
+// Barnes-Hut force error relative to direct summation over sampled bodies
+struct Accuracy {
+    size_t elements, samples;
+    float theta;
+    double meanError, maxError;
+};
+
+std::vector<Accuracy> accuracies;
+
+// Runs setup (untimed) then op (timed) until minTime has been spent in op
+static void measure(const Options& opt, const std::string& name, const std::string& variant, size_t elements,
+                    const std::function<void()>& setup, const std::function<void()>& op) {
+    using clock = std::chrono::steady_clock;
+    double spent = 0;
+    long iterations = 0;
+    while (spent < opt.minTime || iterations < 3) {
+        setup();
+        auto start = clock::now();
+        op();
+        spent += std::chrono::duration<double>(clock::now() - start).count();
+        ++iterations;
+    }
+    Result r{ name, variant, elements, iterations, spent * 1e9 / iterations };
+    std::cerr << name << " [" << variant << "] n=" << elements << ": " << r.nsPerElement() << " ns/element\n";
+    results.push_back(r);
+}
+
+// ------------------ World Setup -------------------
+// Scales the box so that the balls fill the given fraction of its volume
+static void fillWorld(World& world, size_t n, float radius, float volumeFraction, unsigned seed) {
+    world.seed = seed;
+    float ballVolume = 4.0f / 3.0f * 3.14159265f * radius * radius * radius;
+    world.boxSize = 0.5f * std::cbrt(n * ballVolume / volumeFraction);
+    initWorld(world);
+    world.balls.reserve(n);
+    RngStream& rng = world.spawnRng;
+    float extent = world.boxSize - radius;
+    for (size_t i = 0; i < n; ++i) {
+        Vec3 pos;
+        pos.x = rng.range(-extent, extent);
+        pos.y = rng.range(-extent, extent);
+        pos.z = rng.range(-extent, extent);
+        Vec3 vel;
+        vel.x = rng.range(-2, 2);
+        vel.y = rng.range(-2, 2);
+        vel.z = rng.range(-2, 2);
+        world.balls.add(Ball(pos, vel, radius, rng));
+    }
+}
+
+struct Snapshot {
+    std::vector<float> px, py, pz, vx, vy, vz;
+
+    void save(const BallSystem& b) { px = b.px; py = b.py; pz = b.pz; vx = b.vx; vy = b.vy; vz = b.vz; }
+    void restore(BallSystem& b) const { b.px = px; b.py = py; b.pz = pz; b.vx = vx; b.vy = vy; b.vz = vz; }
+};
+
+// ------------------ Cases -------------------
+static void benchIntegrate(const Options& opt, size_t n) {
+    SimdLevel best = resolveSimdLevel(SimdAuto);
+    for (int mask = 0; mask < 8; ++mask) {
+        for (int level = SimdScalar; level <= best; ++level) {
+            World world;
+            world.trailInterval = 0;       // no trail arena; only benchTrails records trails
+            world.simdLevel = static_cast<SimdLevel>(level);
+            fillWorld(world, n, 0.5f, 0.05f, opt.seed);
+            world.blackHoleMode = mask & 1;
+            world.cursorGravityMode = mask & 2;
+            world.wallsAreMagnetic = mask & 4;
+            world.cursorWorldTarget = Vec3(1, 2, 3);
+
+            std::string variant = mask == 0 ? "plain" : "";
+            if (mask & 1) variant += "blackhole";
+            if (mask & 2) variant += variant.empty() ? "cursor" : "+cursor";
+            if (mask & 4) variant += variant.empty() ? "magnetic" : "+magnetic";
+            variant += std::string("/") + simdLevelName(world.simdLevel);
+
+            Snapshot snap;
+            snap.save(world.balls);
+            measure(opt, "integrate", variant, n, [&] { snap.restore(world.balls); }, [&] { integrateBalls(world, 0.016f); });
+        }
+    }
+}
+
+static void benchCollisions(const Options& opt, size_t n) {
+    struct Packing { const char* name; float fraction; };
+    const Packing packings[] = { { "sparse", 0.01f }, { "dense", 0.30f } };
+
+    for (const Packing& p : packings) {
+        for (int brute = 0; brute < 2; ++brute) {
+            if (brute && n > 10000)
+                continue;   // quadratic; larger sizes would take minutes per step
+            World world;
+            world.trailInterval = 0;
+            fillWorld(world, n, 0.5f, p.fraction, opt.seed);
+            world.useSpatialHash = !brute;
+
+            Snapshot snap;
+            snap.save(world.balls);
+            std::string variant = std::string(p.name) + (brute ? "+brute" : "+grid");
+            measure(opt, "collisions", variant, n,
+                    [&] { snap.restore(world.balls); world.sparks.clear(); world.sparks.beginStep(); },
+                    [&] { handleCollisions(world); });
+        }
+    }
+}
+
+static void benchSparks(const Options& opt, size_t n) {
+    SparkPool pool;
+    pool.init(n, static_cast<int>(n));
+    auto setup = [&] {
+        RngStream rng(Rng(opt.seed), Rng::stream(RngSparks));
+        pool.clear();
+        for (size_t i = 0; i < n; ++i) {
+            Vec3 pos, vel;
+            pos.x = rng.range(-5, 5);
+            pos.y = rng.range(-5, 5);
+            pos.z = rng.range(-5, 5);
+            vel.x = rng.range(-3, 3);
+            vel.y = rng.range(-3, 3);
+            vel.z = rng.range(-3, 3);
+            pool.spawn(pos, vel, 0.75f);
+            pool.life[i] = rng.uniform();
+        }
+    };
+    // dt = 0.5 expires about half of the pool in one update
+    measure(opt, "sparks", "update+expire", n, setup, [&] { pool.update(0.5f, -9.8f); });
+}
+
+static void benchTrails(const Options& opt, size_t n) {
+    for (int quantized = 0; quantized < 2; ++quantized) {
+        World world;
+        world.trailQuantized = quantized;
+        fillWorld(world, n, 0.5f, 0.05f, opt.seed);
+        measure(opt, "trail_add", quantized ? "quantized" : "float", n, [] {}, [&] { recordTrails(world); });
+    }
+}
+
+// Mutual gravity: Barnes-Hut build plus traversal against direct summation
+static void benchNbody(const Options& opt, size_t n) {
+    const float thetas[] = { 0.3f, 0.5f, 0.8f };
+    World world;
+    world.trailInterval = 0;
+    fillWorld(world, n, 0.5f, 0.05f, opt.seed);
+    Snapshot snap;
+    snap.save(world.balls);
+
+    for (float theta : thetas) {
+        if (theta < 0.5f && n > 100000)
+            continue;   // a tight angle opens most of the tree; minutes per step at 1M
+        world.nbodyTheta = theta;
+        std::ostringstream variant;
+        variant << "barnes-hut/theta=" << theta;
+        measure(opt, "nbody", variant.str(), n, [&] { snap.restore(world.balls); }, [&] { applyMutualGravity(world, 0.016f); });
+
+        // Relative error of the Barnes-Hut acceleration on up to 1000 evenly spaced bodies
+        size_t samples = std::min<size_t>(n, 1000);
+        double sum = 0, worst = 0;
+        for (size_t s = 0; s < samples; ++s) {
+            size_t i = s * n / samples;
+            Vec3 a = world.octree.acceleration(world.balls, i, theta, world.nbodyG, world.nbodySoftening);
+            Vec3 d = directAcceleration(world.balls, i, world.nbodyG, world.nbodySoftening);
+            double err = d.length() > 0 ? (a - d).length() / d.length() : 0;
+            sum += err;
+            worst = std::max(worst, err);
+        }
+        accuracies.push_back({ n, samples, theta, sum / samples, worst });
+    }
+
+    if (n > 10000)
+        return;   // quadratic; larger sizes would take minutes per step
+    world.nbodyDirect = true;
+    measure(opt, "nbody", "direct", n, [&] { snap.restore(world.balls); }, [&] { applyMutualGravity(world, 0.016f); });
+}
+
+// Integration plus collisions at a fixed size, for strong scaling across thread counts
+static void benchThreads(const Options& opt) {
+    size_t n = std::min<size_t>(opt.maxBalls, 100000);
+    for (int threads = 1; threads <= opt.maxThreads; threads *= 2) {
+        World world;
+        world.trailInterval = 0;
+        world.threadCount = threads;
+        fillWorld(world, n, 0.5f, 0.30f, opt.seed);
+
+        Snapshot snap;
+        snap.save(world.balls);
+        measure(opt, "step_threads", "threads=" + std::to_string(threads), n,
+                [&] { snap.restore(world.balls); world.sparks.clear(); world.sparks.beginStep(); },
+                [&] { integrateBalls(world, 0.016f); handleCollisions(world); });
+    }
+}
+
+// ------------------ JSON Output -------------------
+static std::string jsonString(const std::string& s) { return "\"" + s + "\""; }
+
+static void writeJson(std::ostream& os, const Options& opt) {
+    os << "{\n  \"seed\": " << opt.seed << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        os << "    { \"name\": " << jsonString(r.name) << ", \"variant\": " << jsonString(r.variant)
+           << ", \"elements\": " << r.elements << ", \"iterations\": " << r.iterations
+           << ", \"ns_per_op\": " << r.nsPerOp << ", \"ns_per_element\": " << r.nsPerElement() << " }"
+           << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ],\n  \"scaling\": [\n";
+
+    // Per-element cost at the smallest and largest N of each case. Linear
+    // work keeps this roughly flat; anything growing by more than 4x across
+    // the sweep is flagged.
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& first = results[i];
+        bool seen = false;
+        for (size_t k = 0; k < i; ++k)
+            seen |= results[k].name == first.name && results[k].variant == first.variant;
+        if (seen)
+            continue;
+        const Result* last = &first;
+        for (size_t k = i + 1; k < results.size(); ++k)
+            if (results[k].name == first.name && results[k].variant == first.variant)
+                last = &results[k];
+        if (last == &first)
+            continue;
+        double growth = first.nsPerElement() > 0 ? last->nsPerElement() / first.nsPerElement() : 0;
+        std::ostringstream line;
+        line << "    { \"name\": " << jsonString(first.name) << ", \"variant\": " << jsonString(first.variant)
+             << ", \"min_elements\": " << first.elements << ", \"max_elements\": " << last->elements
+             << ", \"growth\": " << growth << ", \"flag\": " << jsonString(growth > 4.0 ? "superlinear" : "ok") << " }";
+        lines.push_back(line.str());
+    }
+    for (size_t i = 0; i < lines.size(); ++i)
+        os << lines[i] << (i + 1 < lines.size() ? "," : "") << "\n";
+    os << "  ],\n  \"thread_scaling\": [\n";
+
+    // Speedup of each thread count over the single-threaded step
+    const Result* single = nullptr;
+    lines.clear();
+    for (const Result& r : results) {
+        if (r.name != "step_threads")
+            continue;
+        if (!single)
+            single = &r;
+        std::ostringstream line;
+        line << "    { \"variant\": " << jsonString(r.variant) << ", \"elements\": " << r.elements
+             << ", \"speedup\": " << single->nsPerOp / r.nsPerOp << " }";
+        lines.push_back(line.str());
+    }
+    for (size_t i = 0; i < lines.size(); ++i)
+        os << lines[i] << (i + 1 < lines.size() ? "," : "") << "\n";
+    os << "  ],\n  \"nbody_accuracy\": [\n";
+
+    for (size_t i = 0; i < accuracies.size(); ++i) {
+        const Accuracy& a = accuracies[i];
+        os << "    { \"elements\": " << a.elements << ", \"theta\": " << a.theta << ", \"samples\": " << a.samples
+           << ", \"mean_relative_error\": " << a.meanError << ", \"max_relative_error\": " << a.maxError << " }"
+           << (i + 1 < accuracies.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+}
+
+// ------------------ Main Entry Point -------------------
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        std::cerr << "usage: gravity_bench [--max-balls N] [--max-threads N] [--min-time SECONDS] [--seed N] [--out FILE]\n";
+        return 1;
+    }
+
+    for (size_t n = 100; n <= opt.maxBalls; n *= 10) {
+        benchIntegrate(opt, n);
+        benchCollisions(opt, n);
+        benchSparks(opt, n);
+        benchTrails(opt, n);
+        if (n >= 1000)
+            benchNbody(opt, n);
+    }
+    benchThreads(opt);
+
+    if (opt.out.empty()) {
+        writeJson(std::cout, opt);
+    }
+    else {
+        std::ofstream file(opt.out);
+        writeJson(file, opt);
+    }
+    return 0;
+}
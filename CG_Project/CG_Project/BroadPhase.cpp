@@ -0,0 +1,55 @@
+﻿#include "BroadPhase.h"
+
+#include <algorithm>
+
+void SpatialGrid::build(const BallSystem& balls, float box, float minRadius) {
+    float maxRadius = minRadius;
+    for (float r : balls.radius)
+        maxRadius = std::max(maxRadius, r);
+
+    boxSize = box;
+    float span = 2.0f * boxSize;
+    dim = maxRadius > 0 ? static_cast<int>(span / (2.0f * maxRadius)) : 1;
+    dim = std::max(1, std::min(maxDim, dim));
+    cellSize = span / dim;
+
+    size_t cellCount = size_t(dim) * dim * dim;
+    cellStart.assign(cellCount + 1, 0);
+    ballCell.resize(balls.size());
+    cellBalls.resize(balls.size());
+
+    // Counting sort of ball indices by cell
+    for (size_t i = 0; i < balls.size(); ++i) {
+        ballCell[i] = cellIndex(coord(balls.px[i]), coord(balls.py[i]), coord(balls.pz[i]));
+        ++cellStart[ballCell[i] + 1];
+    }
+    for (size_t c = 0; c < cellCount; ++c)
+        cellStart[c + 1] += cellStart[c];
+    std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < balls.size(); ++i)
+        cellBalls[fill[ballCell[i]]++] = static_cast<int>(i);
+
+    // Counting sort of the non-empty cells by colour
+    colorStart.assign(colors + 1, 0);
+    for (int pass = 0; pass < 2; ++pass) {
+        std::vector<int> colorFill;
+        if (pass == 1) {
+            for (int k = 0; k < colors; ++k)
+                colorStart[k + 1] += colorStart[k];
+            colorCells.resize(colorStart[colors]);
+            colorFill.assign(colorStart.begin(), colorStart.end() - 1);
+        }
+        for (int z = 0; z < dim; ++z)
+            for (int y = 0; y < dim; ++y)
+                for (int x = 0; x < dim; ++x) {
+                    int c = cellIndex(x, y, z);
+                    if (cellStart[c + 1] == cellStart[c])
+                        continue;
+                    int color = x % 3 + 3 * (y % 3) + 9 * (z % 3);
+                    if (pass == 0)
+                        ++colorStart[color + 1];
+                    else
+                        colorCells[colorFill[color]++] = c;
+                }
+    }
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include <vector>
+
+#include "BallSystem.h"
+
+// ------------------ Broad Phase -------------------
+// Uniform grid over the box, rebuilt every step. Cells are at least one ball
+// diameter wide so every overlapping pair lives in neighbouring cells.
+//
+// Non-empty cells are also bucketed into 27 colours by (x % 3, y % 3, z % 3).
+// Two cells of the same colour are at least three cells apart on some axis,
+// so their 3x3x3 neighbourhoods never overlap and can be solved concurrently.
+struct SpatialGrid {
+    static constexpr int maxDim = 128;
+    static constexpr int colors = 27;
+
+    int dim = 1;
+    float cellSize = 1.0f;
+    float boxSize = 10.0f;
+    std::vector<int> cellStart;  // prefix offsets into cellBalls, dim^3 + 1 entries
+    std::vector<int> cellBalls;  // ball indices sorted by cell
+    std::vector<int> ballCell;   // cell of each ball
+    std::vector<int> colorStart; // prefix offsets into colorCells, colors + 1 entries
+    std::vector<int> colorCells; // non-empty cells sorted by colour
+
+    int coord(float v) const {
+        int c = static_cast<int>((v + boxSize) / cellSize);
+        return c < 0 ? 0 : c >= dim ? dim - 1 : c;
+    }
+
+    int cellIndex(int cx, int cy, int cz) const { return (cz * dim + cy) * dim + cx; }
+
+    void cellCoords(int c, int& cx, int& cy, int& cz) const {
+        cx = c % dim;
+        cy = (c / dim) % dim;
+        cz = c / (dim * dim);
+    }
+
+    // Cells fit the largest ball, or minRadius if that is larger
+    void build(const BallSystem& balls, float boxSize, float minRadius = 0.0f);
+};
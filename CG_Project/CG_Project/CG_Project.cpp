@@ -1,731 +1,838 @@
-﻿// CG_Project.cpp : This file contains the 'main' function. Program execution begins and ends there.
-
-// Complex 3D Gravity Balls Simulator (700+ LOC)
-
-#include <GL/glut.h>
-#include <cmath>
-#include <cstdlib>
-#include <ctime>
-#include <iomanip>
-#include <iostream>
-#include <sstream>
-#include <string>
-#include <vector>
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
-// ------------------ Vec3 -------------------
-// 3D vector class for position and velocity
-struct Vec3 {
-    float x, y, z;
-
-    // Constructor
-    Vec3(float x = 0, float y = 0, float z = 0) : x(x), y(y), z(z) {}
-
-    // Operator overloads for vector arithmetic
-    Vec3 operator+(const Vec3& b) const { return Vec3(x + b.x, y + b.y, z + b.z); }
-    Vec3 operator-(const Vec3& b) const { return Vec3(x - b.x, y - b.y, z - b.z); }
-    Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
-    Vec3 operator/(float s) const { return Vec3(x / s, y / s, z / s); }
-    Vec3& operator+=(const Vec3& b) {
-        x += b.x;
-        y += b.y;
-        z += b.z;
-        return *this;
-    }
-
-    // Normalization and length calculation
-    float length() const { return sqrt(x * x + y * y + z * z); }
-    Vec3 normalized() const {
-        float l = length();
-        return l > 0 ? *this / l : Vec3();
-    }
-
-    // Dot product and reflection
-    float dot(const Vec3& b) const { return x * b.x + y * b.y + z * b.z; }
-    Vec3 reflect(const Vec3& n) const { return *this - n * 2.0f * this->dot(n); }
-};
-
-// ------------------ Global Config Variables -------------------
-float boxSize = 10.0f;
-float globalGravity = -9.8f;
-float globalFriction = 0.1f;
-float restitution = 0.9f;
-float entropyLevel = 0.0f;
-float timeScale = 1.0f;
-bool paused = false;
-bool showUI = true;
-bool wallsAreMagnetic = false;
-bool blackHoleMode = false;
-bool cursorGravityMode = false;
-int maxParticles = 100;
-int mouseX = 0, mouseY = 0;
-
-// ------------------ Particles -------------------
-Vec3 cursorWorldTarget(0, 0, 0);
-
-// ------------------ Input and Camera -------------------
-float camAngleX = 45, camAngleY = 30;
-float camDist = 40.0f;
-int lastMouseX = -1, lastMouseY = -1;
-bool mouseLeftDown = false;
-
-// ------------------ Time -------------------
-float lastTime = 0;
-
-// ------------------ Sparkles -------------------
-struct Spark {
-    Vec3 pos, vel;
-    float life;
-    float r, g, b;
-
-    Spark(Vec3 p, Vec3 v) : pos(p), vel(v), life(1.0f) {
-        r = 1.0f;
-        g = 0.5f + static_cast<float>(rand()) / RAND_MAX * 0.5f;
-        b = 0.0f;
-    }
-
-    void update(float dt) {
-        life -= dt;
-        vel += Vec3(0, globalGravity, 0) * dt * 0.1f;
-        pos += vel * dt;
-    }
-
-    void draw() const {
-        glColor4f(r, g, b, life);
-        glPointSize(3.0f);
-        glBegin(GL_POINTS);
-        glVertex3f(pos.x, pos.y, pos.z);
-        glEnd();
-    }
-};
-
-// ------------------ Trail -------------------
-struct Trail {
-    std::vector<Vec3> points;
-    void add(Vec3 pos) {
-        points.push_back(pos);
-        if (points.size() > 30)
-            points.erase(points.begin());
-    }
-
-    void draw() const {
-        glBegin(GL_LINE_STRIP);
-        for (size_t i = 0; i < points.size(); ++i) {
-            float alpha = float(i) / points.size();
-            float width = 5.0f + 5.0f * alpha;
-            glColor4f(1.0f, 1.0f - alpha, 1.0f, alpha);
-            glVertex3f(points[i].x, points[i].y, points[i].z);
-        }
-        glEnd();
-    }
-};
-
-// ------------------ Ball -------------------
-struct Ball {
-    Vec3 pos, vel;
-    float radius, mass;
-    float r, g, b;
-    Trail trail;
-
-    Ball(Vec3 p, Vec3 v, float radius = 0.5f) : pos(p), vel(v), radius(radius) {
-        mass = radius * radius * radius;
-        r = static_cast<float>(rand()) / RAND_MAX;
-        g = static_cast<float>(rand()) / RAND_MAX;
-        b = static_cast<float>(rand()) / RAND_MAX;
-    }
-
-    void update(float dt) {
-        if (blackHoleMode) {
-            Vec3 toCenter = Vec3(0, 0, 0) - pos;
-            float distSq = toCenter.length();
-            distSq = std::max(1.0f, distSq);
-            Vec3 pull = toCenter.normalized() * (100.0f / distSq);
-            vel += pull * dt;
-        }
-
-        if (cursorGravityMode) {
-            Vec3 toCursor = cursorWorldTarget - pos;
-            float distSq = toCursor.length();
-            if (distSq > 0.5f) {
-                Vec3 pull = toCursor.normalized() * (200.0f / distSq);
-                vel += pull * dt;
-            }
-        }
-
-        if (wallsAreMagnetic) {
-            float pullStrength = 200.0f;
-            float wallDist = boxSize;
-
-            Vec3 force(0, 0, 0);
-            float dX1 = fabs(-wallDist - pos.x);
-            float dX2 = fabs(wallDist - pos.x);
-            float dY1 = fabs(-wallDist - pos.y);
-            float dY2 = fabs(wallDist - pos.y);
-            float dZ1 = fabs(-wallDist - pos.z);
-            float dZ2 = fabs(wallDist - pos.z);
-
-            force.x += 1.0f / (dX1 * dX1 + 0.1f);
-            force.x -= 1.0f / (dX2 * dX2 + 0.1f);
-
-            force.y += 1.0f / (dY1 * dY1 + 0.1f);
-            force.y -= 1.0f / (dY2 * dY2 + 0.1f);
-
-            force.z += 1.0f / (dZ1 * dZ1 + 0.1f);
-            force.z -= 1.0f / (dZ2 * dZ2 + 0.1f);
-
-            vel += force * pullStrength * dt;
-        }
-
-        vel += Vec3(0, globalGravity, 0) * dt;
-        vel = vel * (1.0f - globalFriction * dt);
-        pos += vel * dt;
-        trail.add(pos);
-        vel.x += ((rand() % 200 - 100) / 100.0f) * entropyLevel * 100.0f * dt;
-        vel.y += ((rand() % 200 - 100) / 100.0f) * entropyLevel * 100.0f * dt;
-        vel.z += ((rand() % 200 - 100) / 100.0f) * entropyLevel * 100.0f * dt;
-    }
-
-    void draw() const {
-        glPushMatrix();
-        glTranslatef(pos.x, pos.y, pos.z);
-        glColor3f(r, g, b);
-        glutSolidSphere(radius, 16, 16);
-        glPopMatrix();
-        trail.draw();
-    }
-};
-
-std::vector<Ball> balls;
-std::vector<Spark> sparks;
-
-// ------------------ Simulation -------------------
-void spawnSparkExplosion(Vec3 position, int count = 10) {
-    for (int i = 0; i < count; ++i) {
-        Vec3 dir(((rand() % 200) - 100) / 100.0f, ((rand() % 200) - 100) / 100.0f, ((rand() % 200) - 100) / 100.0f);
-        sparks.emplace_back(position, dir * 3.0f);
-    }
-}
-
-// ------------------ Collision Handling -------------------
-// This function handles the collision detection and response between balls and walls
-void handleCollisions() {
-    for (size_t i = 0; i < balls.size(); ++i) {
-        Ball& A = balls[i];
-
-        // Wall collisions
-        for (int j = 0; j < 3; ++j) {
-            float* coord = j == 0 ? &A.pos.x : j == 1 ? &A.pos.y : &A.pos.z;
-            float* vel = j == 0 ? &A.vel.x : j == 1 ? &A.vel.y : &A.vel.z;
-            if (*coord - A.radius < -boxSize) {
-                *coord = -boxSize + A.radius;
-                *vel *= -restitution;
-            }
-            if (*coord + A.radius > boxSize) {
-                *coord = boxSize - A.radius;
-                *vel *= -restitution;
-            }
-        }
-
-        // Ball-to-ball collisions
-        for (size_t j = i + 1; j < balls.size(); ++j) {
-            Ball& B = balls[j];
-            Vec3 delta = B.pos - A.pos;
-            float dist = delta.length();
-            float minDist = A.radius + B.radius;
-            if (dist < minDist && dist > 0) {
-                Vec3 normal = delta.normalized();
-                float overlap = 0.5f * (minDist - dist);
-
-                A.pos = A.pos - (normal * overlap);
-                B.pos += normal * overlap;
-
-                Vec3 relVel = B.vel - A.vel;
-                float velAlongNormal = relVel.dot(normal);
-                if (velAlongNormal < 0) {
-                    float impulse = -(1 + restitution) * velAlongNormal;
-                    impulse /= (1 / A.mass + 1 / B.mass);
-                    Vec3 impulseVec = normal * impulse;
-
-                    A.vel = A.vel - (impulseVec / A.mass);
-                    B.vel += impulseVec / B.mass;
-
-                    spawnSparkExplosion((A.pos + B.pos) * 0.5f, 15);
-                }
-            }
-        }
-    }
-}
-
-// ------------------ Simulation Update ------------------- 
-// This function is called every frame to update the simulation state
-void updateSimulation(float dt) {
-    if (paused)
-        return;
-
-    if (blackHoleMode) {
-        for (size_t i = 0; i < balls.size();) {
-            if (balls[i].pos.length() < 1.0f) {
-                if (balls[i].pos.length() < 1.0f) {
-                    spawnSparkExplosion(balls[i].pos, 20);
-                    balls.erase(balls.begin() + i);
-                    continue;
-                }
-                continue;
-            }
-            ++i;
-        }
-    }
-
-    for (auto& b : balls)
-        b.update(dt);
-    handleCollisions();
-
-    for (size_t i = 0; i < sparks.size();) {
-        sparks[i].update(dt);
-        if (sparks[i].life <= 0)
-            sparks.erase(sparks.begin() + i);
-        else
-            ++i;
-    }
-}
-
-// ------------------ Set Background -------------------
-void drawBackgroundGradient() {
-    glDisable(GL_DEPTH_TEST);
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    gluOrtho2D(0, 1, 0, 1);
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-
-    glBegin(GL_QUADS);
-
-    if (blackHoleMode) {
-        glColor3f(0.02f, 0.02f, 0.04f);
-        glVertex2f(0, 1);
-        glColor3f(0.03f, 0.03f, 0.07f);
-        glVertex2f(1, 1);
-        glColor3f(0.05f, 0.04f, 0.08f);
-        glVertex2f(1, 0);
-        glColor3f(0.04f, 0.03f, 0.07f);
-        glVertex2f(0, 0);
-    }
-    else if (wallsAreMagnetic) {
-        glColor3f(0.08f, 0.02f, 0.12f);
-        glVertex2f(0, 1);
-        glColor3f(0.15f, 0.03f, 0.20f);
-        glVertex2f(1, 1);
-        glColor3f(0.12f, 0.00f, 0.10f);
-        glVertex2f(1, 0);
-        glColor3f(0.06f, 0.01f, 0.08f);
-        glVertex2f(0, 0);
-    }
-    else if (cursorGravityMode) {
-        glColor3f(0.02f, 0.07f, 0.10f);
-        glVertex2f(0, 1);
-        glColor3f(0.03f, 0.09f, 0.13f);
-        glVertex2f(1, 1);
-        glColor3f(0.04f, 0.12f, 0.16f);
-        glVertex2f(1, 0);
-        glColor3f(0.03f, 0.10f, 0.14f);
-        glVertex2f(0, 0);
-    }
-    else {
-        glColor3f(0.07f, 0.02f, 0.15f);
-        glVertex2f(0, 1);
-        glColor3f(0.07f, 0.02f, 0.15f);
-        glVertex2f(1, 1);
-        glColor3f(0.02f, 0.1f, 0.12f);
-        glVertex2f(1, 0);
-        glColor3f(0.02f, 0.1f, 0.12f);
-        glVertex2f(0, 0);
-    }
-
-    glEnd();
-
-    glPopMatrix();
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
-    glEnable(GL_DEPTH_TEST);
-}
-
-// ------------------ Draw box -------------------
-void drawBox(float size) {
-    float t = glutGet(GLUT_ELAPSED_TIME) * 0.001f;
-    float pulse = 0.9f + 0.5f * sin(t * 2.0f);
-
-    float r = 0.0f, g = 1.0f * pulse, b = 1.0f * pulse;
-
-    if (blackHoleMode) {
-        r = 0.2f * pulse;
-        g = 0.0f;
-        b = 0.5f + 0.5f * pulse;
-    }
-    else if (wallsAreMagnetic) {
-        r = 1.0f * pulse;
-        g = 0.2f;
-        b = 1.0f * pulse;
-    }
-    else if (cursorGravityMode) {
-        r = 0.0f;
-        g = 1.0f;
-        b = 0.4f + 0.4f * sin(t * 3);
-    }
-
-    glColor3f(r, g, b);
-    glLineWidth(2.5f);
-    glutWireCube(size * 2.0f);
-    glLineWidth(1.0f);
-}
-
-// ------------------ UI-Text Rendering -------------------
-void renderText(float x, float y, const std::string& text) {
-    glRasterPos2f(x, y);
-    for (char c : text)
-        glutBitmapCharacter(GLUT_BITMAP_8_BY_13, c);
-}
-
-// ------------------ UI Rendering -------------------
-// Render the UI with stats and controls
-void renderUI() {
-    if (!showUI)
-        return;
-
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    gluOrtho2D(0, 800, 0, 600);
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-
-    glDisable(GL_LIGHTING);
-    glColor3f(1, 1, 1);
-
-    std::ostringstream oss;
-    oss << std::fixed << std::setprecision(2);
-
-    // Line 1 – Core Stats
-    oss << "Gravity [2/8]: " << globalGravity << "    ";
-    oss << "Friction [4/6]: " << globalFriction << "    ";
-    oss << "Elasticity [A/D]: " << restitution << "    ";
-    oss << "Entropy [Q/E]: " << entropyLevel << "    ";
-    oss << "Balls: " << balls.size() << "    ";
-    oss << "Time Scale [</>]: " << std::fixed << std::setprecision(1) << timeScale;
-    std::string line1 = oss.str();
-
-    // Line 2 – Modes + Controls
-    std::ostringstream oss2;
-    oss2 << "[M] Magnetize Walls: " << (wallsAreMagnetic ? "ON" : "OFF") << "    ";
-    oss2 << "[B] Black Hole: " << (blackHoleMode ? "ON" : "OFF") << "    ";
-    oss2 << "[G] Cursor Gravity: " << (cursorGravityMode ? "ON" : "OFF") << "    ";
-    oss2 << "Zoom [+/-]: " << static_cast<int>(camDist) << "    ";
-    oss2 << "[SPACE] Pause  [R] Reset  [C] Clear  [N] New Ball  [T] UI  [ESC] Quit";
-    std::string line2 = oss2.str();
-
-    // Render lines
-    float y = 580;
-    renderText(10, y, "Gravity Balls 3D - Complex Mode"); y -= 15;
-    renderText(10, y, line1); y -= 15;
-    renderText(10, y, line2);
-
-    glPopMatrix();
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
-}
-
-// ------------------ Render Scene -------------------
-// Main rendering function
-void renderScene() {
-    float t = glutGet(GLUT_ELAPSED_TIME) / 1000.0f;
-    float rawDt = t - lastTime;
-    lastTime = t;
-    float dt = rawDt * timeScale;
-
-    updateSimulation(dt);
-
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    drawBackgroundGradient();
-
-    glLoadIdentity();
-
-    glTranslatef(0, 0, -camDist);
-    glRotatef(camAngleY, 1, 0, 0);
-    glRotatef(camAngleX, 0, 1, 0);
-
-    glEnable(GL_LIGHTING);
-    GLfloat light_pos[] = { 0.0f, 20.0f, 20.0f, 1.0f };
-    glLightfv(GL_LIGHT0, GL_POSITION, light_pos);
-    glEnable(GL_LIGHT0);
-
-    drawBox(boxSize);
-
-    if (blackHoleMode) {
-        glPushMatrix();
-        glTranslatef(0.0f, 0.0f, 0.0f);
-        float t = glutGet(GLUT_ELAPSED_TIME) * 0.001f;
-        float pulse = 0.6f + 0.4f * sin(t * 4.0f);
-
-        glColor3f(0.0f, 0.0f, 0.0f);
-        glutSolidSphere(1.0f, 32, 32);
-        glPushMatrix();
-        glRotatef(t * 100.0f, 0.0f, 1.0f, 0.0f);
-        glColor4f(1.0f, 0.6f, 0.2f, 0.15f);
-        glBegin(GL_LINE_LOOP);
-        for (int i = 0; i < 100; ++i) {
-            float angle = 2.0f * M_PI * i / 100;
-            float x = cos(angle) * 1.5f;
-            float z = sin(angle) * 1.5f;
-            glVertex3f(x, 0.1f, z);
-        }
-        glEnd();
-        glPopMatrix();
-
-        glColor4f(0.6f, 0.1f, 1.0f, 0.08f * pulse);
-        glutSolidSphere(1.6f + 0.1f * sin(t * 3.0f), 32, 32);
-
-        glPopMatrix();
-    }
-
-    if (cursorGravityMode) {
-        GLdouble model[16], proj[16];
-        GLint viewport[4];
-        glGetDoublev(GL_MODELVIEW_MATRIX, model);
-        glGetDoublev(GL_PROJECTION_MATRIX, proj);
-        glGetIntegerv(GL_VIEWPORT, viewport);
-
-        float winX = mouseX;
-        float winY = mouseY;
-        float winZ = 0.5f;
-
-        GLdouble posX, posY, posZ;
-        gluUnProject(winX, winY, winZ, model, proj, viewport, &posX, &posY, &posZ);
-        cursorWorldTarget = Vec3(posX, posY, posZ);
-    }
-
-    for (const auto& b : balls)
-        b.draw();
-
-    glDisable(GL_LIGHTING);
-    for (const auto& s : sparks)
-        s.draw();
-
-    renderUI();
-
-    glutSwapBuffers();
-}
-
-// ------------------ Input Handling -------------------
-void mouse(int button, int state, int x, int y) {
-    if (button == GLUT_LEFT_BUTTON)
-        mouseLeftDown = (state == GLUT_DOWN);
-    lastMouseX = x;
-    lastMouseY = y;
-}
-
-//  ------------------ Passive Motion -------------------
-void passiveMotion(int x, int y) {
-    mouseX = x;
-    mouseY = y;
-}
-
-//  ------------------ Motion -------------------
-void motion(int x, int y) {
-    mouseX = x;
-    mouseY = y;
-
-    if (cursorGravityMode) {
-        GLdouble model[16], proj[16];
-        GLint viewport[4];
-        glGetDoublev(GL_MODELVIEW_MATRIX, model);
-        glGetDoublev(GL_PROJECTION_MATRIX, proj);
-        glGetIntegerv(GL_VIEWPORT, viewport);
-
-        float winX = x;
-        float winY = y;
-        float winZ;
-        glReadPixels(x, int(winY), 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &winZ);
-
-        GLdouble posX, posY, posZ;
-        gluUnProject(winX, winY, 0.5f, model, proj, viewport, &posX, &posY, &posZ);
-
-        cursorWorldTarget = Vec3(posX, posY, posZ);
-    }
-
-    if (mouseLeftDown) {
-        camAngleX += (x - lastMouseX) * 0.5f;
-        camAngleY += (y - lastMouseY) * 0.5f;
-        if (camAngleY < -89.0f)
-            camAngleY = -89.0f;
-        if (camAngleY > 89.0f)
-            camAngleY = 89.0f;
-        lastMouseX = x;
-        lastMouseY = y;
-    }
-}
-
-// ------------------ Keyboard Input -------------------
-void keyboard(unsigned char key, int x, int y) {
-    switch (key) {
-        // --- Simulation Control ---
-    case ' ':
-        paused = !paused;
-        break;
-    case 'r': {
-        balls.clear();
-        for (int i = 0; i < 20; ++i) {
-            Vec3 pos(rand() % 10 - 5, rand() % 10 + 5, rand() % 10 - 5);
-            Vec3 vel((rand() % 100 - 50) / 50.0f, 0, (rand() % 100 - 50) / 50.0f);
-            balls.emplace_back(pos, vel, 0.4f + rand() % 10 / 20.0f);
-        }
-        break;
-    }
-    case 'c':
-        balls.clear();
-        sparks.clear();
-        break;
-    case '<': case ',':
-        timeScale = std::max(0.1f, timeScale - 0.1f);
-        break;
-    case '>': case '.':
-        timeScale = std::min(5.0f, timeScale + 0.1f);
-        break;
-
-        // --- Camera Control ---
-    case '+': case '=':
-        camDist = std::max(5.0f, camDist - 1.0f);
-        break;
-    case '-': case '_':
-        camDist = std::min(100.0f, camDist + 1.0f);
-        break;
-
-        // --- New Ball ---
-    case 'n': {
-        Vec3 pos(rand() % 10 - 5, 10 + rand() % 5, rand() % 10 - 5);
-        Vec3 vel((rand() % 100 - 50) / 50.0f, 0, (rand() % 100 - 50) / 50.0f);
-        balls.emplace_back(pos, vel, 0.5f + (rand() % 10) / 20.0f);
-        break;
-    }
-
-            // --- Physics: Gravity, Friction, Entropy & Elasticity ---
-    case '2':
-        globalGravity -= 1.0f;
-        break;
-    case '8':
-        globalGravity += 1.0f;
-        break;
-    case '4':
-        globalFriction = std::max(0.0f, globalFriction - 0.01f);
-        break;
-    case '6':
-        globalFriction += 0.01f;
-        break;
-    case 'q':
-        entropyLevel = std::max(0.0f, entropyLevel - 0.01f);
-        break;
-    case 'e':
-        entropyLevel += 0.01f;
-        break;
-    case 'a':
-        restitution = std::max(0.0f, restitution - 0.05f);
-        break;
-    case 'd':
-        restitution = std::min(1.0f, restitution + 0.05f);
-        break;
-
-        // --- Modes ---
-    case 'm':
-        wallsAreMagnetic = !wallsAreMagnetic;
-        break;
-    case 'b':
-        blackHoleMode = !blackHoleMode;
-        break;
-    case 'g':
-        cursorGravityMode = !cursorGravityMode;
-        break;
-
-        // --- Toggle UI and Exit ---
-
-    case 't':
-        showUI = !showUI;
-        break;
-    case 27:
-        exit(0);
-        break;
-    }
-}
-
-// ------------------ Reshape Window -------------------
-// This function is called when the window is resized, adjusting the viewport and projection matrix.
-void reshape(int w, int h) {
-    if (h == 0)
-        h = 1;
-    float aspect = float(w) / h;
-    glViewport(0, 0, w, h);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluPerspective(45.0f, aspect, 1.0f, 100.0f);
-    glMatrixMode(GL_MODELVIEW);
-}
-
-// ------------------ Idle Function -------------------
-// This function is called when the program is idle, allowing for continuous updates.
-void idle() { glutPostRedisplay(); }
-
-// ------------------ Main Entry Point -------------------
-// The main function initializes GLUT, sets up the window, and enters the main loop.
-int main(int argc, char** argv) {
-
-    // Initialize GLUT and create a window
-    srand((unsigned int)time(0));
-
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-    glutInitWindowSize(1000, 700);
-    glutCreateWindow("Gravity Balls 3D");
-
-    // Set up OpenGL state
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_COLOR_MATERIAL);
-    glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-
-    // Set up initial state
-    for (int i = 0; i < 20; ++i) {
-        Vec3 pos(rand() % 10 - 5, rand() % 10 + 5, rand() % 10 - 5);
-        Vec3 vel((rand() % 100 - 50) / 50.0f, 0, (rand() % 100 - 50) / 50.0f);
-        balls.emplace_back(pos, vel, 0.4f + rand() % 10 / 20.0f);
-    }
-
-    // Set up callbacks
-    glutDisplayFunc(renderScene);
-    glutReshapeFunc(reshape);
-    glutIdleFunc(idle);
-    glutMouseFunc(mouse);
-    glutMotionFunc(motion);
-    glutKeyboardFunc(keyboard);
-    glutPassiveMotionFunc(passiveMotion);
-
-    glutMainLoop();
-    return 0;
-}
-
-// Run program: Ctrl + F5 or Debug > Start Without Debugging menu
-// Debug program: F5 or Debug > Start Debugging menu
-
-// Tips for Getting Started: 
-//   1. Use the Solution Explorer window to add/manage files
-//   2. Use the Team Explorer window to connect to source control
-//   3. Use the Output window to see build output and other messages
-//   4. Use the Error List window to view errors
-//   5. Go to Project > Add New Item to create new code files, or Project > Add Existing Item to add existing code files to the project
-//   6. In the future, to open this project again, go to File > Open > Project and select the .sln file
+﻿// CG_Project.cpp : This file contains the 'main' function. Program execution begins and ends there.
+
+// Complex 3D Gravity Balls Simulator (700+ LOC)
+
+#ifdef _WIN32
+#include <windows.h>       // wglGetProcAddress
+#endif
+#include <GL/glut.h>
+#ifndef _WIN32
+#include <GL/glx.h>        // glXGetProcAddressARB
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#include "FixedStep.h"
+#include "HudText.h"
+#include "Profiler.h"
+#include "Recording.h"
+#include "Renderer.h"
+#include "SimThread.h"
+#include "World.h"
+
+// ------------------ Simulation State -------------------
+// Physics parameters and state live in the World; this file is only the GLUT
+// front end. After startup the World belongs to the simulation thread: frames
+// are drawn from its published snapshots and input goes through commands.
+World world;
+FixedStepper stepper;
+SimThread sim;
+
+// GL entry points beyond 1.1, from the window system (plain GLUT has no loader)
+static void* loadGlProc(const char* name) {
+#ifdef _WIN32
+    return reinterpret_cast<void*>(wglGetProcAddress(name));
+#else
+    return reinterpret_cast<void*>(glXGetProcAddressARB(reinterpret_cast<const GLubyte*>(name)));
+#endif
+}
+
+// ------------------ Global Config Variables -------------------
+bool showUI = true;
+int mouseX = 0, mouseY = 0;
+
+// ------------------ Rendering -------------------
+Renderer renderer;
+HudText hud;
+const double hudRefreshHz = 4.0;   // rate of the HUD lines that show per-frame counters
+auto hudClock = std::chrono::steady_clock::now();
+bool batchedRendering = true;     // false = the immediate-mode reference path
+size_t frameLimit = 0;            // --frames: exit after this many frames and print render stats
+
+// ------------------ Profiling -------------------
+// Thread 0 times the frame phases here, thread 1 the step phases on the simulation thread
+Profiler profiler({ "render", "simulation" });
+ProfileRecorder* renderProfile = profiler.recorder(0);
+std::string tracePath = "trace.json";   // [K] and --trace write the last traceFrames frames here
+size_t traceFrames = 120;
+bool traceAtExit = false;
+
+// ------------------ Recording and Replay -------------------
+// --record captures every simulation iteration on the simulation thread;
+// --replay draws frames from a mapped recording instead of running the simulation
+RecordingWriter recording;
+RecordingReader replay;
+RecordedFrame replayFrame;
+FrameSnapshot replayView;
+size_t replayIndex = 0;
+double replayTime = 0;            // simulated seconds since the first recorded frame
+bool replayPaused = false;
+auto replayClock = std::chrono::steady_clock::now();
+
+// ------------------ Input and Camera -------------------
+float camAngleX = 45, camAngleY = 30;
+float camDist = 40.0f;
+int lastMouseX = -1, lastMouseY = -1;
+bool mouseLeftDown = false;
+
+// ------------------ Drawing -------------------
+void drawTrail(const FrameSnapshot& frame, size_t slot) {
+    int first = frame.trailStart[slot];
+    int n = frame.trailStart[slot + 1] - first;
+    glBegin(GL_LINE_STRIP);
+    for (int i = 0; i < n; ++i) {
+        float alpha = float(i) / n;
+        const Vec3& p = frame.trailPoints[first + i];
+        glColor4f(1.0f, 1.0f - alpha, 1.0f, alpha);
+        glVertex3f(p.x, p.y, p.z);
+    }
+    glEnd();
+}
+
+void drawBalls(const FrameSnapshot& frame, float blend) {
+    for (size_t i = 0; i < frame.ballCount(); ++i) {
+        Vec3 p = frame.position(i, blend);
+        glPushMatrix();
+        glTranslatef(p.x, p.y, p.z);
+        glColor3f(frame.color[i].r, frame.color[i].g, frame.color[i].b);
+        glutSolidSphere(frame.radius[i], 16, 16);
+        glPopMatrix();
+        drawTrail(frame, i);
+        renderer.stats.drawCalls += 2;
+        renderer.stats.triangles += 16 * 16 * 2;
+    }
+}
+
+void drawSparks(const FrameSnapshot& frame) {
+    glPointSize(3.0f);
+    glBegin(GL_POINTS);
+    for (size_t i = 0; i < frame.sparkCount(); ++i) {
+        glColor4f(1.0f, frame.sparkG[i], 0.0f, frame.sparkLife[i]);
+        glVertex3f(frame.sparkX[i], frame.sparkY[i], frame.sparkZ[i]);
+    }
+    glEnd();
+    ++renderer.stats.drawCalls;
+}
+
+// ------------------ Set Background -------------------
+void drawBackgroundGradient(const FrameSnapshot& frame) {
+    glDisable(GL_DEPTH_TEST);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0, 1, 0, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glBegin(GL_QUADS);
+
+    if (frame.blackHole) {
+        glColor3f(0.02f, 0.02f, 0.04f);
+        glVertex2f(0, 1);
+        glColor3f(0.03f, 0.03f, 0.07f);
+        glVertex2f(1, 1);
+        glColor3f(0.05f, 0.04f, 0.08f);
+        glVertex2f(1, 0);
+        glColor3f(0.04f, 0.03f, 0.07f);
+        glVertex2f(0, 0);
+    }
+    else if (frame.magnetic) {
+        glColor3f(0.08f, 0.02f, 0.12f);
+        glVertex2f(0, 1);
+        glColor3f(0.15f, 0.03f, 0.20f);
+        glVertex2f(1, 1);
+        glColor3f(0.12f, 0.00f, 0.10f);
+        glVertex2f(1, 0);
+        glColor3f(0.06f, 0.01f, 0.08f);
+        glVertex2f(0, 0);
+    }
+    else if (frame.cursorGravity) {
+        glColor3f(0.02f, 0.07f, 0.10f);
+        glVertex2f(0, 1);
+        glColor3f(0.03f, 0.09f, 0.13f);
+        glVertex2f(1, 1);
+        glColor3f(0.04f, 0.12f, 0.16f);
+        glVertex2f(1, 0);
+        glColor3f(0.03f, 0.10f, 0.14f);
+        glVertex2f(0, 0);
+    }
+    else {
+        glColor3f(0.07f, 0.02f, 0.15f);
+        glVertex2f(0, 1);
+        glColor3f(0.07f, 0.02f, 0.15f);
+        glVertex2f(1, 1);
+        glColor3f(0.02f, 0.1f, 0.12f);
+        glVertex2f(1, 0);
+        glColor3f(0.02f, 0.1f, 0.12f);
+        glVertex2f(0, 0);
+    }
+
+    glEnd();
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glEnable(GL_DEPTH_TEST);
+}
+
+// ------------------ Draw box -------------------
+void drawBox(const FrameSnapshot& frame) {
+    float t = glutGet(GLUT_ELAPSED_TIME) * 0.001f;
+    float pulse = 0.9f + 0.5f * sin(t * 2.0f);
+
+    float r = 0.0f, g = 1.0f * pulse, b = 1.0f * pulse;
+
+    if (frame.blackHole) {
+        r = 0.2f * pulse;
+        g = 0.0f;
+        b = 0.5f + 0.5f * pulse;
+    }
+    else if (frame.magnetic) {
+        r = 1.0f * pulse;
+        g = 0.2f;
+        b = 1.0f * pulse;
+    }
+    else if (frame.cursorGravity) {
+        r = 0.0f;
+        g = 1.0f;
+        b = 0.4f + 0.4f * sin(t * 3);
+    }
+
+    glColor3f(r, g, b);
+    glLineWidth(2.5f);
+    glutWireCube(frame.boxSize * 2.0f);
+    glLineWidth(1.0f);
+}
+
+// ------------------ UI Rendering -------------------
+// Value as shown with the given decimals, so a HUD line is only rebuilt when
+// its visible digits change
+double shown(double value, int places) {
+    double scale = std::pow(10.0, places);
+    return std::round(value * scale);
+}
+
+// Render the UI with stats and controls. Setting lines are rebuilt only when a
+// value they show changed, counter lines at a fixed rate; the whole overlay is
+// one cached draw.
+void renderUI(const FrameSnapshot& frame) {
+    if (!showUI)
+        return;
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D(0, 800, 0, 600);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glDisable(GL_LIGHTING);
+    glColor3f(1, 1, 1);
+
+    // Title
+    bool replaying = replay.frameCount() > 0;
+    if (!replaying && hud.changed(0, { 0 }))
+        hud.setText(0, "Gravity Balls 3D - Complex Mode");
+    if (replaying && hud.changed(0, { 1, double(replayIndex), double(replay.frameCount()), double(replayFrame.step), double(replayPaused) })) {
+        std::ostringstream title;
+        title << "Gravity Balls 3D - Replay frame " << replayIndex + 1 << " / " << replay.frameCount() << " (step " << replayFrame.step << ")";
+        title << (replayPaused ? "  PAUSED" : "") << "    [SPACE] Pause  [ / ] Step  { / } Skip 10%";
+        hud.setText(0, title.str());
+    }
+
+    // Lines 1-3 show settings and toggles, keyed only on those, so they keep
+    // their display lists until the user changes something
+    if (hud.changed(1, { shown(frame.gravity, 2), shown(frame.friction, 2), shown(frame.restitution, 2), shown(frame.entropy, 2),
+                         double(static_cast<int>(frame.physicsRate)), shown(frame.timeScale, 1) })) {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(2);
+        oss << "Gravity [2/8]: " << frame.gravity << "    ";
+        oss << "Friction [4/6]: " << frame.friction << "    ";
+        oss << "Elasticity [A/D]: " << frame.restitution << "    ";
+        oss << "Entropy [Q/E]: " << frame.entropy << "    ";
+        oss << "Physics: " << static_cast<int>(frame.physicsRate) << " Hz    ";
+        oss << "Time Scale [</>]: " << std::fixed << std::setprecision(1) << frame.timeScale;
+        hud.setText(1, oss.str());
+    }
+
+    if (hud.changed(2, { double(frame.magnetic), double(frame.blackHole), double(frame.cursorGravity), double(frame.nbody), double(frame.sleep),
+                         double(frame.ccd), double(static_cast<int>(camDist)), double(frame.spatialHash) })) {
+        std::ostringstream oss2;
+        oss2 << "[M] Magnetize Walls: " << (frame.magnetic ? "ON" : "OFF") << "    ";
+        oss2 << "[B] Black Hole: " << (frame.blackHole ? "ON" : "OFF") << "    ";
+        oss2 << "[G] Cursor Gravity: " << (frame.cursorGravity ? "ON" : "OFF") << "    ";
+        oss2 << "[O] N-Body: " << (frame.nbody ? "ON" : "OFF") << "    ";
+        oss2 << "[Z] Sleeping: " << (frame.sleep ? "ON" : "OFF") << "    ";
+        oss2 << "[X] CCD: " << (frame.ccd ? "ON" : "OFF") << "    ";
+        oss2 << "Zoom [+/-]: " << static_cast<int>(camDist) << "    ";
+        oss2 << "[H] Broad Phase: " << (frame.spatialHash ? "GRID" : "BRUTE") << "    ";
+        oss2 << "[SPACE] Pause  [R] Reset  [C] Clear  [N] New Ball  [T] UI  [ESC] Quit";
+        hud.setText(2, oss2.str());
+    }
+
+    if (hud.changed(3, { double(batchedRendering), double(renderer.instanced()), double(frame.solverIterations) })) {
+        std::ostringstream oss3;
+        oss3 << "[I] Renderer: " << (!batchedRendering ? "IMMEDIATE" : renderer.instanced() ? "INSTANCED" : "BATCHED") << "    ";
+        oss3 << "Solver budget: " << frame.solverIterations << " iterations";
+        hud.setText(3, oss3.str());
+    }
+
+    // Lines 4-6 show counters that move every frame. They are keyed on a clock
+    // tick instead, so they are reformatted hudRefreshHz times a second and
+    // stay readable; a toggle that changes their layout still shows at once.
+    double tick = std::floor(std::chrono::duration<double>(std::chrono::steady_clock::now() - hudClock).count() * hudRefreshHz);
+    if (hud.changed(4, { tick })) {
+        std::ostringstream oss4;
+        oss4 << std::fixed << std::setprecision(2);
+        oss4 << "Balls: " << frame.ballCount() << " (" << frame.sleepingBalls << " asleep)    ";
+        oss4 << "Sparks: " << frame.sparkCount() << "/" << frame.sparkCapacity << " (" << frame.sparksDropped << " dropped)    ";
+        oss4 << "Steps: x" << frame.stepsLastFrame << " (" << frame.simMs << " ms)    ";
+        oss4 << "Pairs: " << frame.pairsTested << "    ";
+        oss4 << "CCD sweeps: " << frame.ccdSweeps;
+        hud.setText(4, oss4.str());
+    }
+
+    const RenderStats& rs = renderer.stats;
+    if (hud.changed(5, { tick, double(batchedRendering) })) {
+        std::ostringstream oss5;
+        oss5 << std::fixed << std::setprecision(2);
+        oss5 << "Draw calls: " << rs.drawCalls << "    ";
+        oss5 << "Triangles: " << rs.triangles << " (LOD";
+        for (size_t count : rs.lodBalls)
+            oss5 << " " << count;
+        oss5 << ")    ";
+        if (batchedRendering) {
+            oss5 << "Visible: " << rs.visibleBalls << " (" << rs.culledBalls << " culled, ";
+            oss5 << rs.impostors << " impostors)    ";
+        }
+        oss5 << "Frame: " << rs.avgFrameMs << " ms";
+        hud.setText(5, oss5.str());
+    }
+
+    if (hud.changed(6, { tick })) {
+        std::ostringstream oss6;
+        oss6 << "Contacts: " << frame.contacts << "    ";
+        oss6 << "Solver: " << frame.solverIterationsUsed << "/" << frame.solverIterations << " iterations    ";
+        oss6 << "Warm-started: " << static_cast<int>(std::round(frame.cacheHitRate * 100)) << "%    ";
+        oss6 << "Penetration: " << std::fixed << std::setprecision(3) << frame.residualPenetration;
+        hud.setText(6, oss6.str());
+    }
+
+    // Profiler panel: one line per phase that has samples, on the same tick
+    size_t line = 7;
+    if (profiler.enabled()) {
+        for (int p = 0; p < PhaseCount; ++p) {
+            PhaseStats s = profiler.stats(static_cast<ProfilePhase>(p));
+            if (s.samples == 0)
+                continue;
+            if (hud.changed(line, { double(p), tick })) {
+                std::ostringstream row;
+                row << std::fixed << std::setprecision(3);
+                row << phaseName(static_cast<ProfilePhase>(p)) << ": min " << s.minMs << "  avg " << s.avgMs << "  p99 " << s.p99Ms << " ms";
+                hud.setText(line, row.str());
+            }
+            ++line;
+        }
+        if (profiler.dropped() > 0) {
+            if (hud.changed(line, { -1, double(profiler.dropped()) }))
+                hud.setText(line, "profile events dropped: " + std::to_string(profiler.dropped()));
+            ++line;
+        }
+    }
+    hud.truncate(line);
+    hud.draw();
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// ------------------ Commands -------------------
+void sendCursorTarget(const Vec3& target) {
+    Command cmd;
+    cmd.type = CmdCursorTarget;
+    cmd.target = target;
+    sim.send(cmd);
+}
+
+// ------------------ Replay -------------------
+// Step of a recorded frame; a corrupt header reads as past the end, so the
+// search below never lands on it
+uint64_t replayStep(size_t frame) {
+    const RecordingFrameHeader* fh = replay.frameHeader(frame);
+    return fh ? fh->step : std::numeric_limits<uint64_t>::max();
+}
+
+// Plays the recording back at its recorded rate: the frame shown is the last
+// one whose step time has been reached. Steps grow monotonically, so a binary
+// search over the frame headers finds it.
+const FrameSnapshot& currentReplayFrame() {
+    auto now = std::chrono::steady_clock::now();
+    float seconds = std::chrono::duration<float>(now - replayClock).count();
+    replayClock = now;
+
+    const RecordingHeader& h = replay.header();
+    size_t frames = replay.frameCount();
+    uint64_t firstStep = replayStep(0);
+    if (!replayPaused) {
+        replayTime += seconds;
+        uint64_t target = firstStep + static_cast<uint64_t>(replayTime / h.stepSize);
+        size_t lo = 0, hi = frames;
+        while (hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+            if (replayStep(mid) <= target)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        replayIndex = lo;
+        if (lo == frames - 1)
+            replayPaused = true;
+    }
+    // A corrupt frame keeps the last good one on screen
+    if (!replay.decode(replayIndex, replayFrame) && !replayPaused) {
+        std::cerr << "Replay frame " << replayIndex << " is corrupt\n";
+        replayPaused = true;
+    }
+    replaySnapshot(h, replayFrame, replayView);
+    return replayView;
+}
+
+// Moves the replay to a frame and keeps playback time in step with it
+void seekReplay(long long frame) {
+    long long last = static_cast<long long>(replay.frameCount()) - 1;
+    replayIndex = static_cast<size_t>(std::max(0LL, std::min(last, frame)));
+    uint64_t step = replayStep(replayIndex);
+    if (step != std::numeric_limits<uint64_t>::max())
+        replayTime = (step - replayStep(0)) * replay.header().stepSize;
+}
+
+// ------------------ Trace Export -------------------
+void writeTrace() {
+    profiler.collect();
+    if (profiler.writeChromeTrace(tracePath, traceFrames))
+        std::cout << "wrote " << tracePath << " (last " << traceFrames << " frames)\n";
+    else
+        std::cerr << "cannot write " << tracePath << "\n";
+}
+
+// ------------------ Render Scene -------------------
+// Main rendering function. Physics runs on the simulation thread; this only
+// draws the newest snapshot it has published.
+void renderScene() {
+    auto frameStart = std::chrono::steady_clock::now();
+    uint64_t frameStartNs = profileNow();
+    profiler.collect();
+    const FrameSnapshot& frame = replay.frameCount() > 0 ? currentReplayFrame() : sim.latest();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    drawBackgroundGradient(frame);
+
+    glLoadIdentity();
+
+    glTranslatef(0, 0, -camDist);
+    glRotatef(camAngleY, 1, 0, 0);
+    glRotatef(camAngleX, 0, 1, 0);
+
+    Camera view;
+    view.dist = camDist;
+    view.angleX = camAngleX;
+    view.angleY = camAngleY;
+    view.viewportHeight = static_cast<float>(glutGet(GLUT_WINDOW_HEIGHT));
+    // Blend the last two physics states by where the render clock sits between them
+    float blend = frame.blendAlpha(snapshotClock());
+    renderer.beginFrame(view, frame, blend);
+
+    glEnable(GL_LIGHTING);
+    GLfloat light_pos[] = { 0.0f, 20.0f, 20.0f, 1.0f };
+    glLightfv(GL_LIGHT0, GL_POSITION, light_pos);
+    glEnable(GL_LIGHT0);
+
+    drawBox(frame);
+
+    if (frame.blackHole) {
+        float t = glutGet(GLUT_ELAPSED_TIME) * 0.001f;
+        float pulse = 0.6f + 0.4f * sin(t * 4.0f);
+
+        glColor3f(0.0f, 0.0f, 0.0f);
+        renderer.drawSphere(1.0f, 0.0f, 0.0f, 0.0f);
+        glPushMatrix();
+        glRotatef(t * 100.0f, 0.0f, 1.0f, 0.0f);
+        glColor4f(1.0f, 0.6f, 0.2f, 0.15f);
+        renderer.drawRing(1.5f, 0.1f);
+        glPopMatrix();
+
+        glColor4f(0.6f, 0.1f, 1.0f, 0.08f * pulse);
+        renderer.drawSphere(1.6f + 0.1f * sin(t * 3.0f), 0.0f, 0.0f, 0.0f);
+    }
+
+    if (frame.cursorGravity) {
+        GLdouble model[16], proj[16];
+        GLint viewport[4];
+        glGetDoublev(GL_MODELVIEW_MATRIX, model);
+        glGetDoublev(GL_PROJECTION_MATRIX, proj);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        float winX = mouseX;
+        float winY = mouseY;
+        float winZ = 0.5f;
+
+        GLdouble posX, posY, posZ;
+        gluUnProject(winX, winY, winZ, model, proj, viewport, &posX, &posY, &posZ);
+        sendCursorTarget(Vec3(posX, posY, posZ));
+    }
+
+    {
+        ProfileScope scope(renderProfile, PhaseDrawBalls);
+        if (batchedRendering)
+            renderer.drawBalls(frame);
+        else
+            drawBalls(frame, blend);
+    }
+    glDisable(GL_LIGHTING);
+    {
+        ProfileScope scope(renderProfile, PhaseDrawEffects);
+        if (batchedRendering) {
+            renderer.drawTrails(frame);
+            renderer.drawSparks(frame);
+        }
+        else
+            drawSparks(frame);
+    }
+
+    {
+        ProfileScope scope(renderProfile, PhaseHud);
+        renderUI(frame);
+    }
+
+    glutSwapBuffers();
+    renderer.endFrame(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+    if (renderProfile->active())
+        renderProfile->record(PhaseFrame, frameStartNs, profileNow());
+
+    if (frameLimit && renderer.stats.frames >= frameLimit) {
+        std::cout << "renderer:    " << (!batchedRendering ? "immediate" : renderer.instanced() ? "instanced" : "batched") << "\n";
+        std::cout << "gl renderer: " << glGetString(GL_RENDERER) << "\n";
+        std::cout << "balls:       " << frame.ballCount() << "\n";
+        std::cout << "frames:      " << renderer.stats.frames << "\n";
+        std::cout << "draw calls:  " << renderer.stats.drawCalls << "\n";
+        std::cout << "triangles:   " << renderer.stats.triangles << "\n";
+        std::cout << "visible:     " << renderer.stats.visibleBalls << " (" << renderer.stats.culledBalls << " culled, " << renderer.stats.impostors << " impostors)\n";
+        std::cout << "frame ms:    " << renderer.stats.avgFrameMs << "\n";
+        std::cout << "hud builds:  " << hud.rebuilds << " lines\n";
+        sim.stop();
+        recording.close();
+        if (traceAtExit)
+            writeTrace();
+        exit(0);
+    }
+}
+
+// ------------------ Input Handling -------------------
+void mouse(int button, int state, int x, int y) {
+    if (button == GLUT_LEFT_BUTTON)
+        mouseLeftDown = (state == GLUT_DOWN);
+    lastMouseX = x;
+    lastMouseY = y;
+}
+
+//  ------------------ Passive Motion -------------------
+void passiveMotion(int x, int y) {
+    mouseX = x;
+    mouseY = y;
+}
+
+//  ------------------ Motion -------------------
+void motion(int x, int y) {
+    mouseX = x;
+    mouseY = y;
+
+    if (sim.latest().cursorGravity) {
+        GLdouble model[16], proj[16];
+        GLint viewport[4];
+        glGetDoublev(GL_MODELVIEW_MATRIX, model);
+        glGetDoublev(GL_PROJECTION_MATRIX, proj);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+
+        float winX = x;
+        float winY = y;
+        float winZ;
+        glReadPixels(x, int(winY), 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &winZ);
+
+        GLdouble posX, posY, posZ;
+        gluUnProject(winX, winY, 0.5f, model, proj, viewport, &posX, &posY, &posZ);
+
+        sendCursorTarget(Vec3(posX, posY, posZ));
+    }
+
+    if (mouseLeftDown) {
+        camAngleX += (x - lastMouseX) * 0.5f;
+        camAngleY += (y - lastMouseY) * 0.5f;
+        if (camAngleY < -89.0f)
+            camAngleY = -89.0f;
+        if (camAngleY > 89.0f)
+            camAngleY = 89.0f;
+        lastMouseX = x;
+        lastMouseY = y;
+    }
+}
+
+// ------------------ Keyboard Input -------------------
+// Simulation changes are forwarded to the simulation thread; camera and UI
+// state stay on this thread
+void keyboard(unsigned char key, int x, int y) {
+    switch (key) {
+        // --- Simulation Control ---
+    case ' ':
+        if (replay.frameCount() > 0) {
+            if (replayPaused && replayIndex + 1 == replay.frameCount())
+                seekReplay(0);
+            replayPaused = !replayPaused;
+        }
+        else
+            sim.send(CmdTogglePause);
+        break;
+    case '[':
+    case ']':
+    case '{':
+    case '}':
+        if (replay.frameCount() > 0) {
+            long long jump = (key == '[' || key == ']') ? 1 : std::max<long long>(1, replay.frameCount() / 10);
+            seekReplay(static_cast<long long>(replayIndex) + (key == '[' || key == '{' ? -jump : jump));
+            replayPaused = true;
+        }
+        break;
+    case 'r':
+        sim.send(CmdReset);
+        break;
+    case 'c':
+        sim.send(CmdClear);
+        break;
+    case '<': case ',':
+        sim.send(CmdTimeScale, -0.1f);
+        break;
+    case '>': case '.':
+        sim.send(CmdTimeScale, 0.1f);
+        break;
+
+        // --- Camera Control ---
+    case '+': case '=':
+        camDist = std::max(5.0f, camDist - 1.0f);
+        break;
+    case '-': case '_':
+        camDist = std::min(100.0f, camDist + 1.0f);
+        break;
+
+        // --- New Ball ---
+    case 'n':
+        sim.send(CmdSpawnBall);
+        break;
+
+            // --- Physics: Gravity, Friction, Entropy & Elasticity ---
+    case '2':
+        sim.send(CmdGravity, -1.0f);
+        break;
+    case '8':
+        sim.send(CmdGravity, 1.0f);
+        break;
+    case '4':
+        sim.send(CmdFriction, -0.01f);
+        break;
+    case '6':
+        sim.send(CmdFriction, 0.01f);
+        break;
+    case 'q':
+        sim.send(CmdEntropy, -0.01f);
+        break;
+    case 'e':
+        sim.send(CmdEntropy, 0.01f);
+        break;
+    case 'a':
+        sim.send(CmdRestitution, -0.05f);
+        break;
+    case 'd':
+        sim.send(CmdRestitution, 0.05f);
+        break;
+
+        // --- Modes ---
+    case 'm':
+        sim.send(CmdToggleMagnetic);
+        break;
+    case 'b':
+        sim.send(CmdToggleBlackHole);
+        break;
+    case 'g':
+        sim.send(CmdToggleCursorGravity);
+        break;
+    case 'h':
+        sim.send(CmdToggleBroadPhase);
+        break;
+    case 'o':
+        sim.send(CmdToggleNbody);
+        break;
+    case 'z':
+        sim.send(CmdToggleSleep);
+        break;
+    case 'x':
+        sim.send(CmdToggleCcd);
+        break;
+
+        // --- Toggle UI and Exit ---
+
+    case 't':
+        showUI = !showUI;
+        break;
+    case 'i':
+        batchedRendering = !batchedRendering;
+        break;
+    case 'p':
+        profiler.setEnabled(!profiler.enabled());
+        break;
+    case 'k':
+        writeTrace();
+        break;
+    case 27:
+        sim.stop();
+        recording.close();
+        if (traceAtExit)
+            writeTrace();
+        exit(0);
+        break;
+    }
+}
+
+// ------------------ Reshape Window -------------------
+// This function is called when the window is resized, adjusting the viewport and projection matrix.
+void reshape(int w, int h) {
+    if (h == 0)
+        h = 1;
+    float aspect = float(w) / h;
+    glViewport(0, 0, w, h);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(45.0f, aspect, 1.0f, 100.0f);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// ------------------ Idle Function -------------------
+// This function is called when the program is idle, allowing for continuous updates.
+void idle() { glutPostRedisplay(); }
+
+// ------------------ Main Entry Point -------------------
+// The main function initializes GLUT, sets up the window, and enters the main loop.
+int main(int argc, char** argv) {
+
+    // Initialize GLUT and create a window
+    world.seed = static_cast<uint64_t>(time(0));
+
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+    glutInitWindowSize(1000, 700);
+    glutCreateWindow("Gravity Balls 3D");
+
+    // Options left after GLUT has taken its own
+    int startBalls = 20;
+    const char* recordPath = nullptr;
+    bool recordQuantized = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--balls") && i + 1 < argc)
+            startBalls = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+            frameLimit = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--immediate"))
+            batchedRendering = false;
+        else if (!strcmp(argv[i], "--profile"))
+            profiler.setEnabled(true);
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            tracePath = argv[++i];
+            traceAtExit = true;
+            profiler.setEnabled(true);
+        }
+        else if (!strcmp(argv[i], "--trace-frames") && i + 1 < argc)
+            traceFrames = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (!strcmp(argv[i], "--quantize"))
+            recordQuantized = true;
+        else if (!strcmp(argv[i], "--trail-every") && i + 1 < argc)
+            world.trailInterval = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--trail-quantize"))
+            world.trailQuantized = true;
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+            if (!replay.open(argv[++i]) || replay.frameCount() == 0 || !replay.frameHeader(0)) {
+                std::cerr << "cannot replay " << argv[i] << "\n";
+                return 1;
+            }
+        }
+    }
+
+    if (!renderer.init(loadGlProc))
+        std::cerr << "Instanced rendering unavailable; drawing the cached sphere once per ball\n";
+
+    // Set up OpenGL state
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_COLOR_MATERIAL);
+    glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+    // Set up initial state
+    world.threadCount = std::max(1u, std::thread::hardware_concurrency());
+    world.boxSize = std::max(world.boxSize, spawnBoxSize(startBalls, SpawnParams()));
+    initWorld(world);
+    world.profiler = profiler.recorder(1);
+    SpawnReport spawn = spawnStartingBalls(world, startBalls);
+    std::cout << "spawned " << spawn.placed << " balls in " << spawn.seconds * 1000 << " ms\n";
+    if (recordPath) {
+        if (!recording.open(recordPath, world, stepper.stepSize(), recordQuantized)) {
+            std::cerr << "cannot write " << recordPath << "\n";
+            return 1;
+        }
+        sim.record(&recording);
+    }
+    // A replay only draws the recording; the simulation never starts
+    if (replay.frameCount() == 0)
+        sim.start(world, stepper);
+
+    // Set up callbacks
+    glutDisplayFunc(renderScene);
+    glutReshapeFunc(reshape);
+    glutIdleFunc(idle);
+    glutMouseFunc(mouse);
+    glutMotionFunc(motion);
+    glutKeyboardFunc(keyboard);
+    glutPassiveMotionFunc(passiveMotion);
+
+    glutMainLoop();
+    return 0;
+}
+
+// Run program: Ctrl + F5 or Debug > Start Without Debugging menu
+// Debug program: F5 or Debug > Start Debugging menu
+
+// Tips for Getting Started: 
+//   1. Use the Solution Explorer window to add/manage files
+//   2. Use the Team Explorer window to connect to source control
+//   3. Use the Output window to see build output and other messages
+//   4. Use the Error List window to view errors
+//   5. Go to Project > Add New Item to create new code files, or Project > Add Existing Item to add existing code files to the project
+//   6. In the future, to open this project again, go to File > Open > Project and select the .sln file
@@ -0,0 +1,531 @@
+﻿// Distributed.cpp : Steps one world split into slabs across several worker processes.
+//
+// The box is cut into --slabs slabs along x (default: one per worker) and
+// each of --workers forked processes steps a contiguous range of them (see
+// Domain.h), one thread per slab. Every step each slab publishes its boundary
+// balls, its departing balls and their cached impulses into shared memory,
+// all slabs meet at a process-shared barrier, and each slab then reads the
+// lists it needs and steps. During the step the slabs meet again at every
+// exchange of the collision solve. At the end every ball is written back by id
+// and the parent prints a checksum.
+//
+// Usage: gravity_distributed [--balls N] [--steps N] [--dt SECONDS] [--seed N] [--entropy X] [--workers N] [--slabs N] [--halo X]
+//                            [--no-sleep] [--no-ccd] [--iterations N] [--verify] [--tolerance X] [--weak]
+//   --verify     also steps the same slabs in a single process and compares every ball bit for bit, then
+//                steps one undivided World and fails if any ball's position or velocity ends further than
+//                --tolerance from it. With --no-sleep --no-ccd the two agree exactly, so --tolerance 0 holds.
+//   --weak       weak scaling: 1..N workers, one slab and --balls balls per worker
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "BroadPhase.h"
+#include "Domain.h"
+#include "Spawn.h"
+#include "World.h"
+
+// ------------------ Options -------------------
+struct Options {
+    int balls = 20000;
+    int steps = 300;
+    float dt = 1.0f / 60.0f;
+    unsigned long long seed = 1;
+    float entropy = 0.0f;
+    int workers = 2;
+    int slabs = 0;              // 0 = one per worker
+    float halo = 4 * SpawnParams().maxRadius;
+    bool sleep = true;
+    bool ccd = true;
+    int iterations = 8;
+    bool verify = false;
+    float tolerance = 0.05f;    // --verify: largest position or velocity divergence allowed from an undivided run
+    bool weak = false;
+};
+
+static void usage() {
+    std::cerr << "usage: gravity_distributed [--balls N] [--steps N] [--dt SECONDS] [--seed N] [--entropy X] [--workers N] [--slabs N] [--halo X]\n"
+                 "                           [--no-sleep] [--no-ccd] [--iterations N] [--verify] [--tolerance X] [--weak]\n";
+}
+
+static bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "--balls") && hasValue)
+            opt.balls = atoi(argv[++i]);
+        else if (!strcmp(arg, "--steps") && hasValue)
+            opt.steps = atoi(argv[++i]);
+        else if (!strcmp(arg, "--dt") && hasValue)
+            opt.dt = static_cast<float>(atof(argv[++i]));
+        else if (!strcmp(arg, "--seed") && hasValue)
+            opt.seed = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(arg, "--entropy") && hasValue)
+            opt.entropy = static_cast<float>(atof(argv[++i]));
+        else if (!strcmp(arg, "--workers") && hasValue)
+            opt.workers = atoi(argv[++i]);
+        else if (!strcmp(arg, "--slabs") && hasValue)
+            opt.slabs = atoi(argv[++i]);
+        else if (!strcmp(arg, "--halo") && hasValue)
+            opt.halo = static_cast<float>(atof(argv[++i]));
+        else if (!strcmp(arg, "--no-sleep"))
+            opt.sleep = false;
+        else if (!strcmp(arg, "--no-ccd"))
+            opt.ccd = false;
+        else if (!strcmp(arg, "--iterations") && hasValue)
+            opt.iterations = atoi(argv[++i]);
+        else if (!strcmp(arg, "--verify"))
+            opt.verify = true;
+        else if (!strcmp(arg, "--tolerance") && hasValue)
+            opt.tolerance = static_cast<float>(atof(argv[++i]));
+        else if (!strcmp(arg, "--weak"))
+            opt.weak = true;
+        else
+            return false;
+    }
+    return opt.balls > 0 && opt.steps >= 0 && opt.dt > 0 && opt.workers >= 1 && opt.slabs >= 0 && opt.iterations >= 1 &&
+           opt.tolerance >= 0;
+}
+
+static void configureWorld(World& world, const Options& opt) {
+    world.seed = opt.seed;
+    world.entropyLevel = opt.entropy;
+    world.sleepEnabled = opt.sleep;
+    world.ccdEnabled = opt.ccd;
+    world.solverIterations = opt.iterations;
+    world.threadCount = 1;
+    world.trailInterval = 0;
+}
+
+// ------------------ Shared Memory -------------------
+// One anonymous shared mapping, created before the fork:
+//   header | slab stats [slabs] | mailbox sizes [slabs] | mailboxes [slabs][capacity]
+//          | impulse sizes [slabs] | impulse lists [slabs][capacity * impulsesPerBall]
+//          | exchange changes [2][slabs] | exchange sizes [2][slabs] | exchange lists [2][slabs][capacity] | results [balls]
+// A slab never publishes more balls, ghosts or updates than exist, so capacity
+// is the ball count. Cached impulses past impulsesPerBall per ball are not
+// sent, and those pairs start cold. Untouched pages of the lists are never
+// allocated.
+struct SlabTotals {
+    double seconds = 0;
+    size_t ghosts = 0;            // ghosts summed over steps
+    size_t migrations = 0;        // arrivals summed over steps
+    size_t contacts = 0;          // contacts solved, summed over steps
+};
+
+struct SharedHeader {
+    pthread_barrier_t barrier;    // one thread per slab meets here
+};
+
+class SharedRegion {
+public:
+    static const size_t impulsesPerBall = 32;
+
+    SharedRegion(int slabs, size_t balls) : slabs(slabs), capacity(balls) {
+        statsOffset = align(sizeof(SharedHeader));
+        sizesOffset = align(statsOffset + slabs * sizeof(SlabTotals));
+        mailOffset = align(sizesOffset + slabs * sizeof(size_t));
+        impulseSizesOffset = align(mailOffset + slabs * capacity * sizeof(BallRecord));
+        impulseOffset = align(impulseSizesOffset + slabs * sizeof(size_t));
+        changeOffset = align(impulseOffset + slabs * impulseCapacity() * sizeof(CachedContact));
+        updateSizesOffset = align(changeOffset + 2 * slabs * sizeof(float));
+        updateOffset = align(updateSizesOffset + 2 * slabs * sizeof(size_t));
+        resultOffset = align(updateOffset + 2 * slabs * capacity * sizeof(BallUpdate));
+        size = resultOffset + balls * sizeof(BallRecord);
+        void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (map == MAP_FAILED)
+            return;
+        base = static_cast<unsigned char*>(map);
+        for (int s = 0; s < slabs; ++s)
+            new (&stats(s)) SlabTotals();
+
+        pthread_barrierattr_t attr;
+        pthread_barrierattr_init(&attr);
+        pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_barrier_init(&header().barrier, &attr, slabs);
+        pthread_barrierattr_destroy(&attr);
+    }
+
+    ~SharedRegion() {
+        if (!base)
+            return;
+        pthread_barrier_destroy(&header().barrier);
+        munmap(base, size);
+    }
+
+    SharedRegion(const SharedRegion&) = delete;
+    SharedRegion& operator=(const SharedRegion&) = delete;
+
+    bool ok() const { return base != nullptr; }
+
+    SharedHeader& header() { return *reinterpret_cast<SharedHeader*>(base); }
+    SlabTotals& stats(int slab) { return reinterpret_cast<SlabTotals*>(base + statsOffset)[slab]; }
+    size_t* sizes() { return reinterpret_cast<size_t*>(base + sizesOffset); }
+    BallRecord* mailbox(int slab) { return reinterpret_cast<BallRecord*>(base + mailOffset) + slab * capacity; }
+    size_t impulseCapacity() const { return capacity * impulsesPerBall; }
+    size_t* impulseSizes() { return reinterpret_cast<size_t*>(base + impulseSizesOffset); }
+    CachedContact* impulses(int slab) { return reinterpret_cast<CachedContact*>(base + impulseOffset) + slab * impulseCapacity(); }
+    float* changes(int parity) { return reinterpret_cast<float*>(base + changeOffset) + parity * slabs; }
+    size_t* updateSizes(int parity) { return reinterpret_cast<size_t*>(base + updateSizesOffset) + parity * slabs; }
+    BallUpdate* updates(int parity, int slab) { return reinterpret_cast<BallUpdate*>(base + updateOffset) + (parity * slabs + slab) * capacity; }
+    BallRecord* results() { return reinterpret_cast<BallRecord*>(base + resultOffset); }
+
+    void wait() { pthread_barrier_wait(&header().barrier); }
+
+private:
+    static size_t align(size_t n) { return (n + 63) & ~size_t(63); }
+
+    unsigned char* base = nullptr;
+    size_t size = 0;
+    int slabs;
+    size_t capacity;
+    size_t statsOffset = 0, sizesOffset = 0, mailOffset = 0, impulseSizesOffset = 0, impulseOffset = 0, changeOffset = 0, updateSizesOffset = 0, updateOffset = 0, resultOffset = 0;
+};
+
+// Exchanges alternate between two sets of lists. A slab writes set p only
+// after passing the barrier of the exchange before, which every slab reaches
+// after it finished reading set p from the exchange before that.
+class SharedLink : public SlabLink {
+public:
+    explicit SharedLink(SharedRegion& shared) : shared(shared) {}
+
+    float post(int slab, const std::vector<BallUpdate>& updates, float change) override {
+        parity ^= 1;
+        std::copy(updates.begin(), updates.end(), shared.updates(parity, slab));
+        shared.updateSizes(parity)[slab] = updates.size();
+        shared.changes(parity)[slab] = change;
+        shared.wait();
+        const float* all = shared.changes(parity);
+        return *std::max_element(all, all + slabCount);
+    }
+
+    const BallUpdate* updates(int slab) override { return shared.updates(parity, slab); }
+    size_t updateCount(int slab) override { return shared.updateSizes(parity)[slab]; }
+
+    int slabCount = 1;
+
+private:
+    SharedRegion& shared;
+    int parity = 0;
+};
+
+// ------------------ Workers -------------------
+// One thread per slab: steps it in lockstep with every other slab and writes its balls back by id
+static void runSlab(int index, const Options& opt, const DomainLayout& layout, const BallSystem& all, SharedRegion& shared) {
+    Slab slab;
+    configureWorld(slab.world, opt);
+    slab.init(index, layout, all);
+    SharedLink link(shared);
+    link.slabCount = layout.slabs;
+
+    SlabTotals& stats = shared.stats(index);
+    std::vector<BallRecord> out;
+    std::vector<CachedContact> impulses;
+    std::vector<const BallRecord*> lists(layout.slabs);
+    std::vector<const CachedContact*> impulseLists(layout.slabs);
+    for (int t = 0; t < layout.slabs; ++t) {
+        lists[t] = shared.mailbox(t);
+        impulseLists[t] = shared.impulses(t);
+    }
+    size_t* sizes = shared.sizes();
+    size_t* impulseSizes = shared.impulseSizes();
+
+    shared.wait();
+    auto start = std::chrono::steady_clock::now();
+    for (int step = 0; step < opt.steps; ++step) {
+        // Every slab reads the mailboxes before its first exchange, so none is
+        // rewritten here while another slab still reads it
+        slab.publish(out, impulses);
+        std::copy(out.begin(), out.end(), shared.mailbox(index));
+        sizes[index] = out.size();
+        impulseSizes[index] = std::min(impulses.size(), shared.impulseCapacity());
+        std::copy(impulses.begin(), impulses.begin() + impulseSizes[index], shared.impulses(index));
+        shared.wait();
+
+        slab.receive(lists.data(), sizes, impulseLists.data(), impulseSizes);
+        slab.step(opt.dt, link);
+        stats.ghosts += slab.stats().ghosts;
+        stats.migrations += slab.stats().arrivals;
+        stats.contacts += slab.stats().contacts;
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    BallRecord* results = shared.results();
+    const BallSystem& balls = slab.world.balls;
+    for (size_t i = 0; i < balls.size(); ++i)
+        results[balls.id[i]] = recordBall(balls, i);
+}
+
+// Runs in the forked child: steps slabs [first, last). A failing slab ends the
+// whole process, since the other slabs would wait for it at the barrier forever.
+static void runWorker(int worker, const Options& opt, const DomainLayout& layout, const BallSystem& all, SharedRegion& shared) {
+    int first = worker * layout.slabs / opt.workers;
+    int last = (worker + 1) * layout.slabs / opt.workers;
+    std::vector<std::thread> threads;
+    for (int s = first; s < last; ++s)
+        threads.emplace_back([&, s] {
+            try {
+                runSlab(s, opt, layout, all, shared);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "slab " << s << ": " << e.what() << "\n";
+                _exit(1);
+            }
+        });
+    for (std::thread& t : threads)
+        t.join();
+}
+
+struct RunResult {
+    bool ok = false;
+    float boxSize = 0;
+    int slabs = 0;
+    double seconds = 0;
+    size_t ghosts = 0, migrations = 0;
+    size_t contacts = 0;              // contacts solved, summed over steps and slabs
+    std::vector<BallRecord> balls;    // final state, indexed by id
+};
+
+// Spawns the world, forks one process per worker and waits for all of them;
+// if one fails the others are stopped, since they would wait at the barrier forever
+static RunResult runDistributed(const Options& opt) {
+    RunResult result;
+    World world;
+    configureWorld(world, opt);
+    SpawnParams spawn;
+    spawn.count = opt.balls;
+    world.boxSize = std::max(world.boxSize, spawnBoxSize(opt.balls, spawn));
+    initWorld(world);
+    spawnBalls(world, spawn);
+
+    DomainLayout layout;
+    layout.slabs = opt.slabs ? opt.slabs : opt.workers;
+    layout.boxSize = world.boxSize;
+    layout.halo = opt.halo;
+    result.boxSize = layout.boxSize;
+    result.slabs = layout.slabs;
+    if (!layout.valid() || opt.workers > layout.slabs) {
+        std::cerr << opt.workers << " workers, " << layout.slabs << " slabs of width " << layout.width() << ", halo " << layout.halo
+                  << ": the halo must be positive and fit in one slab, with at least one slab per worker\n";
+        return result;
+    }
+
+    // Each slab solves the cells centred in it, so its ghosts must cover the
+    // neighbours of a cell reaching half a cell past the face
+    SpatialGrid grid;
+    grid.build(world.balls, world.boxSize);
+    if (layout.halo < 1.5f * grid.cellSize) {
+        std::cerr << "halo " << layout.halo << ": must be at least one and a half grid cells (" << 1.5f * grid.cellSize << ")\n";
+        return result;
+    }
+
+    size_t n = world.balls.size();
+    SharedRegion shared(layout.slabs, n);
+    if (!shared.ok()) {
+        std::cerr << "cannot map shared memory\n";
+        return result;
+    }
+
+    std::cout.flush();
+    std::vector<pid_t> children;
+    for (int w = 0; w < opt.workers; ++w) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int status = 0;
+            try {
+                runWorker(w, opt, layout, world.balls, shared);
+            }
+            catch (const std::exception& e) {
+                std::cerr << "worker " << w << ": " << e.what() << "\n";
+                status = 1;
+            }
+            _exit(status);
+        }
+        if (pid < 0) {
+            std::cerr << "fork failed\n";
+            for (pid_t child : children)
+                kill(child, SIGTERM);
+            break;
+        }
+        children.push_back(pid);
+    }
+
+    bool ok = children.size() == size_t(opt.workers);
+    for (size_t done = 0; done < children.size(); ++done) {
+        int status = 0;
+        if (waitpid(-1, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            if (ok)
+                for (pid_t child : children)
+                    kill(child, SIGTERM);
+            ok = false;
+        }
+    }
+    if (!ok) {
+        std::cerr << "a worker failed\n";
+        return result;
+    }
+
+    for (int s = 0; s < layout.slabs; ++s) {
+        result.seconds = std::max(result.seconds, shared.stats(s).seconds);
+        result.ghosts += shared.stats(s).ghosts;
+        result.migrations += shared.stats(s).migrations;
+        result.contacts += shared.stats(s).contacts;
+    }
+    result.balls.assign(shared.results(), shared.results() + n);
+    result.ok = true;
+    return result;
+}
+
+// Order-sensitive hash of the final positions and velocities, by ball id
+static unsigned long long stateChecksum(const std::vector<BallRecord>& balls) {
+    unsigned long long h = 1469598103934665603ull;
+    for (const BallRecord& b : balls) {
+        const float values[] = { b.px, b.py, b.pz, b.vx, b.vy, b.vz };
+        for (float v : values) {
+            unsigned bits;
+            memcpy(&bits, &v, sizeof(bits));
+            h = (h ^ bits) * 1099511628211ull;
+        }
+    }
+    return h;
+}
+
+static bool sameState(const BallRecord& a, const BallRecord& b) {
+    const float x[] = { a.px, a.py, a.pz, a.vx, a.vy, a.vz }, y[] = { b.px, b.py, b.pz, b.vx, b.vy, b.vz };
+    return !memcmp(x, y, sizeof(x));
+}
+
+// ------------------ Undivided Reference -------------------
+// The same spawn stepped as one World in this process, for measuring how far
+// the decomposition drifts from it
+struct Divergence {
+    float position = 0, velocity = 0;     // largest difference of any ball
+    double meanPosition = 0;              // position difference averaged over balls
+    size_t contacts = 0;                  // contacts summed over steps
+    double seconds = 0;
+};
+
+static Divergence compareUndivided(const Options& opt, const RunResult& run) {
+    World world;
+    configureWorld(world, opt);
+    SpawnParams spawn;
+    spawn.count = opt.balls;
+    world.boxSize = std::max(world.boxSize, spawnBoxSize(opt.balls, spawn));
+    initWorld(world);
+    spawnBalls(world, spawn);
+
+    Divergence d;
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < opt.steps; ++s) {
+        updateSimulation(world, opt.dt);
+        d.contacts += world.contacts.size();
+    }
+    d.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const BallSystem& balls = world.balls;
+    for (size_t i = 0; i < balls.size(); ++i) {
+        const BallRecord& r = run.balls[balls.id[i]];
+        float dp = (balls.position(i) - Vec3(r.px, r.py, r.pz)).length();
+        d.position = std::max(d.position, dp);
+        d.velocity = std::max(d.velocity, (balls.velocity(i) - Vec3(r.vx, r.vy, r.vz)).length());
+        d.meanPosition += dp;
+    }
+    if (!balls.empty())
+        d.meanPosition /= balls.size();
+    return d;
+}
+
+// ------------------ Weak Scaling -------------------
+// Balls per worker stay fixed while workers are added, one slab each; ideal
+// scaling keeps the step time flat. The box grows in every direction, so
+// slabs get thinner and the halo takes a larger share as workers are added.
+// Per-core efficiency divides out workers sharing a core, leaving the cost of
+// ghosts and exchange.
+static int weakScaling(const Options& base) {
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "weak scaling: " << base.balls << " balls per worker, " << base.steps << " steps, " << cores << " hardware threads\n";
+    std::cout << "workers      balls     box   ms/step  efficiency  per-core  ghosts/slab  migrations/step\n";
+    double baseline = 0;
+    for (int w = 1; w <= base.workers; ++w) {
+        Options opt = base;
+        opt.workers = w;
+        opt.slabs = w;
+        opt.balls = base.balls * w;
+        RunResult run = runDistributed(opt);
+        if (!run.ok)
+            return 1;
+        double perStep = opt.steps ? run.seconds / opt.steps : 0;
+        if (w == 1)
+            baseline = perStep;
+        double efficiency = perStep > 0 ? baseline / perStep : 0;
+        std::cout << std::setw(7) << w << std::setw(11) << opt.balls << std::setw(8) << std::fixed << std::setprecision(1) << run.boxSize
+                  << std::setw(10) << std::setprecision(2) << perStep * 1000 << std::setw(12) << efficiency
+                  << std::setw(10) << efficiency * w / std::min(w, cores)
+                  << std::setw(13) << std::setprecision(0) << (opt.steps ? double(run.ghosts) / opt.steps / w : 0)
+                  << std::setw(17) << std::setprecision(1) << (opt.steps ? double(run.migrations) / opt.steps : 0)
+                  << std::defaultfloat << std::setprecision(6) << "\n";
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 1;
+    }
+    if (opt.weak)
+        return weakScaling(opt);
+
+    RunResult run = runDistributed(opt);
+    if (!run.ok)
+        return 1;
+
+    std::cout << "balls:       " << run.balls.size() << " (box " << run.boxSize << ")\n";
+    std::cout << "workers:     " << opt.workers << " processes, " << run.slabs << " slabs, halo " << opt.halo << "\n";
+    std::cout << "steps:       " << opt.steps << " (dt " << opt.dt << ")\n";
+    std::cout << "elapsed:     " << run.seconds << " s\n";
+    std::cout << "steps/sec:   " << (run.seconds > 0 ? opt.steps / run.seconds : 0) << "\n";
+    if (opt.steps > 0)
+        std::cout << "exchange:    " << double(run.ghosts) / opt.steps << " ghosts, " << double(run.migrations) / opt.steps << " migrations per step\n";
+    std::cout << "checksum:    " << std::hex << stateChecksum(run.balls) << std::dec << "\n";
+
+    if (opt.verify) {
+        Options single = opt;
+        single.workers = 1;
+        single.slabs = run.slabs;
+        RunResult reference = runDistributed(single);
+        if (!reference.ok)
+            return 1;
+        size_t mismatched = 0;
+        for (size_t i = 0; i < run.balls.size(); ++i)
+            mismatched += !sameState(run.balls[i], reference.balls[i]);
+        std::cout << "verify:      " << (mismatched ? "MISMATCH" : "match") << " against one process (" << reference.seconds << " s), "
+                  << mismatched << " balls differ\n";
+
+        Divergence undivided = compareUndivided(opt, run);
+        long long contactDiff = static_cast<long long>(run.contacts) - static_cast<long long>(undivided.contacts);
+        std::cout << "undivided:   max divergence " << undivided.position << " position (mean " << undivided.meanPosition << "), "
+                  << undivided.velocity << " velocity (" << undivided.seconds << " s)\n";
+        std::cout << "contacts:    " << run.contacts << " decomposed, " << undivided.contacts << " undivided (" << std::showpos << contactDiff
+                  << std::noshowpos << ")\n";
+        bool drifted = std::max(undivided.position, undivided.velocity) > opt.tolerance;
+        std::cout << "tolerance:   " << (drifted ? "EXCEEDED" : "within") << " " << opt.tolerance << " of the undivided run\n";
+        if (mismatched || drifted)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,225 @@
+﻿#include "Domain.h"
+
+#include <algorithm>
+#include <cfloat>
+
+// ------------------ Ball Records -------------------
+BallRecord recordBall(const BallSystem& balls, size_t i) {
+    BallRecord r;
+    r.px = balls.px[i]; r.py = balls.py[i]; r.pz = balls.pz[i];
+    r.vx = balls.vx[i]; r.vy = balls.vy[i]; r.vz = balls.vz[i];
+    r.radius = balls.radius[i];
+    r.invMass = balls.invMass[i];
+    r.restTime = balls.restTime[i];
+    r.color = balls.color[i];
+    r.id = balls.id[i];
+    r.sleeping = balls.sleeping[i];
+    return r;
+}
+
+// Appends a ball under its original id; trails start empty
+static void appendBall(BallSystem& balls, const BallRecord& r) {
+    size_t i = balls.grow(1);
+    balls.px[i] = r.px; balls.py[i] = r.py; balls.pz[i] = r.pz;
+    balls.vx[i] = r.vx; balls.vy[i] = r.vy; balls.vz[i] = r.vz;
+    balls.radius[i] = r.radius;
+    balls.invMass[i] = r.invMass;
+    balls.restTime[i] = r.restTime;
+    balls.color[i] = r.color;
+    balls.id[i] = r.id;
+    balls.sleeping[i] = static_cast<uint8_t>(r.sleeping);
+}
+
+// ------------------ Slab -------------------
+void Slab::init(int index, const DomainLayout& domain, const BallSystem& all) {
+    slab = index;
+    layout = domain;
+    world.boxSize = layout.boxSize;
+    initWorld(world);
+    // Cells as wide as the undivided world's, so both colour the same cells
+    world.gridRadius = 0.0f;
+    world.cellsFrom = slab > 0 ? layout.lo(slab) : -FLT_MAX;
+    world.cellsTo = slab < layout.slabs - 1 ? layout.hi(slab) : FLT_MAX;
+    for (size_t i = 0; i < all.size(); ++i) {
+        world.gridRadius = std::max(world.gridRadius, all.radius[i]);
+        if (layout.slabOf(all.px[i]) == slab)
+            appendBall(world.balls, recordBall(all, i));
+    }
+    owned = world.balls.size();
+    counts = SlabStats();
+    counts.owned = owned;
+}
+
+bool Slab::inHalo(float x) const {
+    return layout.slabOf(x) != slab && x >= layout.lo(slab) - layout.halo && x < layout.hi(slab) + layout.halo;
+}
+
+// The ball a cached pair belongs to: the lower id, or the ball of a wall contact
+static uint32_t cacheOwner(const CachedContact& c) { return static_cast<uint32_t>(c.key >> 32); }
+
+void Slab::publish(std::vector<BallRecord>& out, std::vector<CachedContact>& impulses) {
+    BallSystem& balls = world.balls;
+    float lo = layout.lo(slab) + layout.halo, hi = layout.hi(slab) - layout.halo;
+    bool left = slab > 0, right = slab < layout.slabs - 1;
+    out.clear();
+    counts.departures = 0;
+    for (size_t i = 0; i < balls.size();) {
+        float x = balls.px[i];
+        if (layout.slabOf(x) != slab) {
+            out.push_back(recordBall(balls, i));
+            balls.remove(i);
+            ++counts.departures;
+            continue;
+        }
+        if ((left && x < lo) || (right && x >= hi))
+            out.push_back(recordBall(balls, i));
+        ++i;
+    }
+
+    // sent already holds the ghosts of the last step
+    for (const BallRecord& r : out)
+        sent.push_back(r.id);
+    std::sort(sent.begin(), sent.end());
+    impulses.clear();
+    for (const CachedContact& c : world.contactCache)
+        if (std::binary_search(sent.begin(), sent.end(), cacheOwner(c)))
+            impulses.push_back(c);
+}
+
+void Slab::receive(const BallRecord* const* lists, const size_t* sizes,
+                   const CachedContact* const* impulseLists, const size_t* impulseSizes) {
+    BallSystem& balls = world.balls;
+
+    // The balls kept, the migrants and then the ghosts. A ball that just left
+    // this slab comes back as a ghost from its own list.
+    held.clear();
+    for (size_t i = 0; i < balls.size(); ++i)
+        held.emplace_back(recordBall(balls, i), false);
+    for (int t = 0; t < layout.slabs; ++t)
+        for (size_t k = 0; t != slab && k < sizes[t]; ++k)
+            if (layout.slabOf(lists[t][k].px) == slab)
+                held.emplace_back(lists[t][k], false);
+    counts.arrivals = held.size() - balls.size();
+    owned = held.size();
+    for (int t = 0; t < layout.slabs; ++t)
+        for (size_t k = 0; k < sizes[t]; ++k)
+            if (inHalo(lists[t][k].px))
+                held.emplace_back(lists[t][k], true);
+    counts.ghosts = held.size() - owned;
+
+    // Laid out in id order, as the undivided world holds them, so the grid
+    // files them and pairs them up in the same order
+    std::sort(held.begin(), held.end(), [](const std::pair<BallRecord, bool>& a, const std::pair<BallRecord, bool>& b) {
+        return a.first.id < b.first.id;
+    });
+    balls.clear();
+    world.ghosts.clear();
+    for (const std::pair<BallRecord, bool>& h : held) {
+        appendBall(balls, h.first);
+        world.ghosts.push_back(h.second);
+    }
+
+    // Impulses cached by other slabs for the pairs of balls held here; the
+    // cache stays sorted by key
+    std::vector<CachedContact>& cache = world.contactCache;
+    for (int t = 0; t < layout.slabs; ++t)
+        for (size_t k = 0; t != slab && k < impulseSizes[t]; ++k)
+            if (std::binary_search(balls.id.begin(), balls.id.end(), cacheOwner(impulseLists[t][k])))
+                cache.push_back(impulseLists[t][k]);
+    std::sort(cache.begin(), cache.end(), [](const CachedContact& x, const CachedContact& y) { return x.key < y.key; });
+
+    // The same test publish used finds the balls the neighbours take as ghosts
+    float lo = layout.lo(slab) + layout.halo, hi = layout.hi(slab) - layout.halo;
+    bool left = slab > 0, right = slab < layout.slabs - 1;
+    shared.clear();
+    for (size_t i = 0; i < balls.size(); ++i)
+        if (world.ghosts[i] || (left && balls.px[i] < lo) || (right && balls.px[i] >= hi))
+            shared.emplace_back(balls.id[i], i);
+}
+
+void Slab::step(float dt, SlabLink& slabLink) {
+    link = &slabLink;
+    world.exchange = this;
+    updateSimulation(world, dt);
+    world.exchange = nullptr;
+    counts.contacts = world.contacts.size();
+
+    // Nothing adds or removes balls during the step, so the marks still hold
+    BallSystem& balls = world.balls;
+    sent.clear();
+    for (size_t i = balls.size(); i-- > 0;) {
+        if (world.ghosts[i]) {
+            sent.push_back(balls.id[i]);
+            balls.remove(i);
+        }
+    }
+    world.ghosts.clear();
+    counts.owned = owned;
+}
+
+void Slab::begin(World& w) {
+    const BallSystem& balls = w.balls;
+    sharedPos.resize(shared.size());
+    sharedVel.resize(shared.size());
+    for (size_t k = 0; k < shared.size(); ++k) {
+        sharedPos[k] = balls.position(shared[k].second);
+        sharedVel[k] = balls.velocity(shared[k].second);
+    }
+}
+
+// Every copy of a shared ball starts from the same state and receives the
+// same updates, so all copies stay equal. A ball only one slab changed takes
+// that slab's values as they are; a ball several slabs changed adds up what
+// each of them changed, in slab order.
+float Slab::exchange(World& w, ExchangeStage stage, float change) {
+    BallSystem& balls = w.balls;
+    bool positions = stage != ExchangeVelocities, velocities = stage != ExchangePositions;
+    outgoing.clear();
+    for (size_t k = 0; k < shared.size(); ++k) {
+        size_t i = shared[k].second;
+        Vec3 p = balls.position(i), v = balls.velocity(i);
+        bool moved = positions && (p.x != sharedPos[k].x || p.y != sharedPos[k].y || p.z != sharedPos[k].z);
+        bool pushed = velocities && (v.x != sharedVel[k].x || v.y != sharedVel[k].y || v.z != sharedVel[k].z);
+        if (moved || pushed)
+            outgoing.push_back({ p.x, p.y, p.z, v.x, v.y, v.z, shared[k].first });
+    }
+    float largest = link->post(slab, outgoing, change);
+
+    // Each list is sorted by id, like shared, so one cursor per list walks it once
+    cursor.assign(layout.slabs, 0);
+    for (size_t k = 0; k < shared.size(); ++k) {
+        uint32_t id = shared[k].first;
+        size_t i = shared[k].second;
+        Vec3 p = sharedPos[k], v = sharedVel[k];
+        int updates = 0;
+        for (int t = 0; t < layout.slabs; ++t) {
+            const BallUpdate* list = t == slab ? outgoing.data() : link->updates(t);
+            size_t count = t == slab ? outgoing.size() : link->updateCount(t);
+            size_t& c = cursor[t];
+            while (c < count && list[c].id < id)
+                ++c;
+            if (c == count || list[c].id != id)
+                continue;
+            const BallUpdate& u = list[c];
+            if (updates++ == 0) {
+                p = Vec3(u.px, u.py, u.pz);
+                v = Vec3(u.vx, u.vy, u.vz);
+            }
+            else {
+                p += Vec3(u.px, u.py, u.pz) - sharedPos[k];
+                v += Vec3(u.vx, u.vy, u.vz) - sharedVel[k];
+            }
+            if (t != slab && balls.sleeping[i])
+                balls.wake(i);
+        }
+        if (positions) {
+            balls.setPosition(i, p);
+            sharedPos[k] = p;
+        }
+        if (velocities) {
+            balls.setVelocity(i, v);
+            sharedVel[k] = v;
+        }
+    }
+    return largest;
+}
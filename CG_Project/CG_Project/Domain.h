@@ -0,0 +1,144 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "World.h"
+
+// ------------------ Domain Decomposition -------------------
+// Splits the box into slabs along x. Each slab steps its own World holding
+// the balls it owns, plus ghost copies of the balls other slabs own within
+// `halo` of its faces. Ghosts are taken at the start of every step and
+// dropped again after it, so their results never count. A ball that ends a
+// step outside its slab migrates to the slab it is in.
+//
+// Every slab holds its balls in id order, as an undivided World does, and
+// builds the same grid. A grid cell belongs to the slab its centre lies in,
+// and only that slab solves the contacts found from it, so each colour batch
+// holds the same contacts in the same order as in a single World. Ghosts must
+// therefore reach one and a half cells past each face. The slabs step
+// together: each stage of the collision solve, down to every colour of the
+// warm start and of every solver pass, ends with an exchange (see
+// BallExchange) that carries what each slab changed on the balls near a face
+// to every copy of them. With sleeping and CCD off the result matches an
+// undivided run bit for bit. Sleeping islands and chains of swept impacts are
+// still found per slab, so with either on the result drifts from an undivided
+// run by a small amount; gravity_distributed --verify measures by how much.
+//
+// A slab's step depends only on its own state and on what every slab
+// published for that step, never on which process steps which slab. For a
+// given slab count, any number of workers therefore gives the same result
+// bit for bit. Ball removal (black hole mode) and mutual gravity need the
+// whole world and are not supported.
+
+// One ball as sent between slabs, either as a ghost or as a migrant
+struct BallRecord {
+    float px, py, pz;
+    float vx, vy, vz;
+    float radius, invMass, restTime;
+    Color color;
+    uint32_t id;
+    uint32_t sleeping;
+};
+
+// A shared ball as one slab left it, sent when that slab changed it since the last exchange
+struct BallUpdate {
+    float px, py, pz;
+    float vx, vy, vz;
+    uint32_t id;
+};
+
+struct DomainLayout {
+    int slabs = 1;
+    float boxSize = 10.0f;
+    float halo = 2.0f;            // ghosts are taken this far beyond each face
+
+    float width() const { return 2.0f * boxSize / slabs; }
+    float lo(int slab) const { return -boxSize + slab * width(); }
+    float hi(int slab) const { return -boxSize + (slab + 1) * width(); }
+
+    int slabOf(float x) const {
+        int s = static_cast<int>((x + boxSize) / width());
+        return s < 0 ? 0 : s >= slabs ? slabs - 1 : s;
+    }
+
+    // Ghosts only come from the neighbouring slabs while the halo fits in one slab
+    bool valid() const { return slabs >= 1 && halo > 0 && halo <= width(); }
+};
+
+struct SlabStats {
+    size_t owned = 0;             // balls owned after the last step
+    size_t ghosts = 0;            // ghosts taken for the last step
+    size_t arrivals = 0;          // balls migrated in before the last step
+    size_t departures = 0;        // balls migrated out before the last step
+    size_t contacts = 0;          // contacts solved in the last step
+};
+
+// Carries the exchanges of one step between the slabs. post() publishes this
+// slab's updates, sorted by id, and its largest change, waits until every slab
+// has posted and returns the largest change of all; every slab's updates are
+// then readable until the next post.
+class SlabLink {
+public:
+    virtual ~SlabLink() = default;
+    virtual float post(int slab, const std::vector<BallUpdate>& updates, float change) = 0;
+    virtual const BallUpdate* updates(int slab) = 0;
+    virtual size_t updateCount(int slab) = 0;
+};
+
+class Slab : public BallExchange {
+public:
+    // world must be configured (parameters, seed, threadCount) but not yet
+    // initialised; takes the balls of `all` that lie in the slab
+    void init(int index, const DomainLayout& layout, const BallSystem& all);
+
+    // Writes every ball another slab may need: the ones within halo of an
+    // inner face and the ones that left the slab, which are removed here,
+    // and the impulses cached for their pairs and for those of the last
+    // step's ghosts (keyed by the lower id), since the cell a pair is found
+    // in may belong to another slab next step
+    void publish(std::vector<BallRecord>& out, std::vector<CachedContact>& impulses);
+
+    // Takes migrants and ghosts from every slab's published list, in slab
+    // order, and the cached impulses of the pairs of the balls it now holds
+    void receive(const BallRecord* const* lists, const size_t* counts,
+                 const CachedContact* const* impulseLists, const size_t* impulseCounts);
+
+    // Steps owned balls and ghosts together, exchanging through link at every
+    // stage of the solve, then drops the ghosts. Every slab must step at once.
+    void step(float dt, SlabLink& link);
+
+    // BallExchange, called by the world during step()
+    void begin(World& world) override;
+    float exchange(World& world, ExchangeStage stage, float change) override;
+
+    int index() const { return slab; }
+    const SlabStats& stats() const { return counts; }
+
+    World world;
+
+private:
+    bool inHalo(float x) const;
+
+    int slab = 0;
+    DomainLayout layout;
+    size_t owned = 0;
+    SlabStats counts;
+
+    std::vector<std::pair<BallRecord, bool>> held;    // balls of the next step; true for ghosts
+    std::vector<uint32_t> sent;                       // ids whose cached impulses are published
+
+    // Balls other slabs hold copies of this step: owned balls they take as
+    // ghosts and this slab's ghosts, as (id, index) sorted by id, with their
+    // state at the last exchange
+    std::vector<std::pair<uint32_t, size_t>> shared;
+    std::vector<Vec3> sharedPos, sharedVel;
+    std::vector<BallUpdate> outgoing;
+    std::vector<size_t> cursor;
+    SlabLink* link = nullptr;
+};
+
+// Record of ball i, for publishing or gathering results
+BallRecord recordBall(const BallSystem& balls, size_t i);
@@ -0,0 +1,35 @@
+﻿#include "FixedStep.h"
+
+#include <cmath>
+
+int advanceFixed(World& world, FixedStepper& stepper, float frameSeconds) {
+    stepper.stepsLastFrame = 0;
+    if (world.paused)
+        return 0;
+
+    float h = stepper.stepSize();
+    stepper.accumulator += frameSeconds * world.timeScale;
+
+    int steps = 0;
+    while (stepper.accumulator >= h && steps < stepper.maxSubsteps) {
+        const BallSystem& balls = world.balls;
+        stepper.prevX = balls.px;
+        stepper.prevY = balls.py;
+        stepper.prevZ = balls.pz;
+        stepper.prevGeneration = balls.generation;
+
+        updateSimulation(world, h);
+        stepper.accumulator -= h;
+        ++steps;
+    }
+
+    // Spiral-of-death guard: drop whole steps we had no budget for
+    if (stepper.accumulator >= h) {
+        float behind = std::floor(stepper.accumulator / h);
+        stepper.droppedSteps += static_cast<size_t>(behind);
+        stepper.accumulator -= behind * h;
+    }
+
+    stepper.stepsLastFrame = steps;
+    return steps;
+}
@@ -0,0 +1,34 @@
+﻿#pragma once
+
+#include <vector>
+
+#include "World.h"
+
+// ------------------ Fixed Timestep -------------------
+// Decouples physics from the frame rate. Frame time (scaled by timeScale)
+// goes into an accumulator that is drained in steps of exactly 1 / physicsRate
+// seconds. At most maxSubsteps run per frame; time beyond that is dropped so
+// a slow frame cannot snowball into ever more work. Positions from before the
+// last step are kept so the renderer can blend between the last two states;
+// they only apply while the ball generation they were taken at is current.
+struct FixedStepper {
+    float physicsRate = 120.0f;   // physics steps per simulated second
+    int maxSubsteps = 8;          // most steps run for one frame
+
+    float accumulator = 0.0f;     // simulated time not yet stepped
+    int stepsLastFrame = 0;
+    size_t droppedSteps = 0;      // whole steps discarded by the substep cap so far
+
+    std::vector<float> prevX, prevY, prevZ;
+    uint64_t prevGeneration = 0;  // BallSystem::generation when prevX/Y/Z were taken
+
+    float stepSize() const { return 1.0f / physicsRate; }
+
+    // True when prevX/Y/Z hold the same balls, in the same order, as the world
+    bool hasPrevious(const World& world) const {
+        return prevGeneration == world.balls.generation && prevX.size() == world.balls.size();
+    }
+};
+
+// Runs as many fixed steps as the accumulated time allows; returns how many ran
+int advanceFixed(World& world, FixedStepper& stepper, float frameSeconds);
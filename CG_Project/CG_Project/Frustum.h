@@ -0,0 +1,60 @@
+﻿#pragma once
+
+#include <cmath>
+
+// ------------------ View Frustum -------------------
+// Six planes taken from projection * modelview (column-major, as returned by
+// glGetFloatv); normals point inwards, so a point is inside when every plane
+// gives a non-negative distance.
+struct Frustum {
+    enum Side { Outside, Intersecting, Inside };
+
+    float planes[6][4] = {};
+
+    void extract(const float* projection, const float* modelview) {
+        float m[16];
+        for (int c = 0; c < 4; ++c)
+            for (int r = 0; r < 4; ++r) {
+                float sum = 0;
+                for (int k = 0; k < 4; ++k)
+                    sum += projection[k * 4 + r] * modelview[c * 4 + k];
+                m[c * 4 + r] = sum;
+            }
+        // Left, right, bottom, top, near, far: row 3 plus or minus rows 0, 1, 2
+        for (int p = 0; p < 6; ++p) {
+            int row = p / 2;
+            float sign = (p % 2) ? -1.0f : 1.0f;
+            for (int c = 0; c < 4; ++c)
+                planes[p][c] = m[c * 4 + 3] + sign * m[c * 4 + row];
+            float len = std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+            for (int c = 0; c < 4; ++c)
+                planes[p][c] /= len;
+        }
+    }
+
+    bool sphereVisible(float x, float y, float z, float radius) const {
+        for (const float* p : planes)
+            if (p[0] * x + p[1] * y + p[2] * z + p[3] < -radius)
+                return false;
+        return true;
+    }
+
+    bool pointVisible(float x, float y, float z) const { return sphereVisible(x, y, z, 0.0f); }
+
+    // Axis-aligned box test using the corners nearest and farthest along each normal
+    Side classifyBox(const float lo[3], const float hi[3]) const {
+        Side side = Inside;
+        for (const float* p : planes) {
+            float most = p[3], least = p[3];
+            for (int a = 0; a < 3; ++a) {
+                most += p[a] * (p[a] >= 0 ? hi[a] : lo[a]);
+                least += p[a] * (p[a] >= 0 ? lo[a] : hi[a]);
+            }
+            if (most < 0)
+                return Outside;
+            if (least < 0)
+                side = Intersecting;
+        }
+        return side;
+    }
+};
@@ -0,0 +1,332 @@
+﻿// Headless.cpp : Runs the simulation without a window and reports throughput.
+//
+// Usage: gravity_headless [--balls N] [--steps N] [--dt SECONDS] [--seed N] [--entropy X] [--threads N] [--simd scalar|sse2|avx2|auto] [--brute] [--nbody bh|direct] [--theta X] [--no-sleep] [--no-ccd] [--iterations N] [--no-warm-start] [--trace FILE] [--trace-frames N]
+//                         [--record FILE] [--record-every N] [--quantize] [--trail-every N] [--trail-quantize]
+//        gravity_headless --replay FILE [--frame N]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "Profiler.h"
+#include "Recording.h"
+#include "Spawn.h"
+#include "World.h"
+
+// ------------------ Options -------------------
+struct Options {
+    int balls = 1000;
+    int steps = 1000;
+    float dt = 1.0f / 60.0f;
+    float timeScale = 1.0f;
+    float radius = 0.0f;            // every ball this radius; 0 = the spawn default range
+    unsigned long long seed = 1;
+    float entropy = 0.0f;
+    int threads = 1;
+    SimdLevel simd = SimdAuto;
+    bool brute = false;
+    int nbody = 0;              // 0 off, 1 Barnes-Hut, 2 direct summation
+    float theta = 0.5f;
+    bool sleep = true;
+    bool ccd = true;
+    int iterations = 8;
+    bool warmStart = true;
+    const char* trace = nullptr;    // Chrome trace of the last traceSteps steps
+    size_t traceSteps = 120;
+    const char* record = nullptr;   // binary recording of the run
+    int recordEvery = 1;
+    bool quantize = false;
+    int trailEvery = 0;             // trail point every N steps; 0 = no trails, as nothing draws them
+    bool trailQuantize = false;
+    const char* replay = nullptr;   // inspect a recording instead of simulating
+    long long frame = -1;           // frame to inspect; -1 = the last one
+    bool checkCcd = false;          // fail unless sweeps hit and no pair ends a step overlapped past the slop
+};
+
+static void usage() {
+    std::cerr << "usage: gravity_headless [--balls N] [--steps N] [--dt SECONDS] [--time-scale X] [--radius R] [--seed N] [--entropy X] [--threads N] [--simd scalar|sse2|avx2|auto] [--brute] [--nbody bh|direct] [--theta X] [--no-sleep] [--no-ccd] [--iterations N] [--no-warm-start] [--trace FILE] [--trace-frames N]\n"
+                 "                        [--record FILE] [--record-every N] [--quantize] [--trail-every N] [--trail-quantize] [--check-ccd]\n"
+                 "       gravity_headless --replay FILE [--frame N]\n";
+}
+
+static bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "--balls") && hasValue)
+            opt.balls = atoi(argv[++i]);
+        else if (!strcmp(arg, "--steps") && hasValue)
+            opt.steps = atoi(argv[++i]);
+        else if (!strcmp(arg, "--dt") && hasValue)
+            opt.dt = static_cast<float>(atof(argv[++i]));
+        else if (!strcmp(arg, "--time-scale") && hasValue)
+            opt.timeScale = static_cast<float>(atof(argv[++i]));
+        else if (!strcmp(arg, "--radius") && hasValue)
+            opt.radius = static_cast<float>(atof(argv[++i]));
+        else if (!strcmp(arg, "--seed") && hasValue)
+            opt.seed = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(arg, "--entropy") && hasValue)
+            opt.entropy = static_cast<float>(atof(argv[++i]));
+        else if (!strcmp(arg, "--threads") && hasValue)
+            opt.threads = atoi(argv[++i]);
+        else if (!strcmp(arg, "--simd") && hasValue) {
+            const char* name = argv[++i];
+            int level = SimdScalar;
+            while (level <= SimdAuto && strcmp(name, simdLevelName(static_cast<SimdLevel>(level))))
+                ++level;
+            if (level > SimdAuto)
+                return false;
+            opt.simd = static_cast<SimdLevel>(level);
+        }
+        else if (!strcmp(arg, "--brute"))
+            opt.brute = true;
+        else if (!strcmp(arg, "--nbody") && hasValue) {
+            const char* mode = argv[++i];
+            if (!strcmp(mode, "bh"))
+                opt.nbody = 1;
+            else if (!strcmp(mode, "direct"))
+                opt.nbody = 2;
+            else
+                return false;
+        }
+        else if (!strcmp(arg, "--theta") && hasValue)
+            opt.theta = static_cast<float>(atof(argv[++i]));
+        else if (!strcmp(arg, "--no-sleep"))
+            opt.sleep = false;
+        else if (!strcmp(arg, "--no-ccd"))
+            opt.ccd = false;
+        else if (!strcmp(arg, "--iterations") && hasValue)
+            opt.iterations = atoi(argv[++i]);
+        else if (!strcmp(arg, "--no-warm-start"))
+            opt.warmStart = false;
+        else if (!strcmp(arg, "--trace") && hasValue)
+            opt.trace = argv[++i];
+        else if (!strcmp(arg, "--trace-frames") && hasValue)
+            opt.traceSteps = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(arg, "--record") && hasValue)
+            opt.record = argv[++i];
+        else if (!strcmp(arg, "--record-every") && hasValue)
+            opt.recordEvery = atoi(argv[++i]);
+        else if (!strcmp(arg, "--quantize"))
+            opt.quantize = true;
+        else if (!strcmp(arg, "--trail-every") && hasValue)
+            opt.trailEvery = atoi(argv[++i]);
+        else if (!strcmp(arg, "--trail-quantize"))
+            opt.trailQuantize = true;
+        else if (!strcmp(arg, "--replay") && hasValue)
+            opt.replay = argv[++i];
+        else if (!strcmp(arg, "--frame") && hasValue)
+            opt.frame = atoll(argv[++i]);
+        else if (!strcmp(arg, "--check-ccd"))
+            opt.checkCcd = true;
+        else
+            return false;
+    }
+    return opt.balls >= 0 && opt.steps >= 0 && opt.dt > 0 && opt.timeScale > 0 && opt.radius >= 0 && opt.threads >= 1 && opt.recordEvery >= 1 && opt.iterations >= 1 && opt.trailEvery >= 0;
+}
+
+// Order-sensitive hash of the final positions, for comparing runs
+static unsigned long long stateChecksum(const std::vector<float>& px, const std::vector<float>& py, const std::vector<float>& pz) {
+    unsigned long long h = 1469598103934665603ull;
+    const std::vector<float>* arrays[] = { &px, &py, &pz };
+    for (const auto* a : arrays)
+        for (float v : *a) {
+            unsigned bits;
+            memcpy(&bits, &v, sizeof(bits));
+            h = (h ^ bits) * 1099511628211ull;
+        }
+    return h;
+}
+
+// The position passes approach the slop from above without reaching it, so
+// --check-ccd allows a pair this share past it
+static const float overlapAllowance = 1.1f;
+
+// Deepest overlap between any two balls, tested pair by pair, for --check-ccd
+static float deepestOverlap(const BallSystem& balls) {
+    float deepest = 0;
+    for (size_t a = 0; a < balls.size(); ++a)
+        for (size_t b = a + 1; b < balls.size(); ++b) {
+            float depth = balls.radius[a] + balls.radius[b] - (balls.position(b) - balls.position(a)).length();
+            deepest = std::max(deepest, depth);
+        }
+    return deepest;
+}
+
+// ------------------ Replay -------------------
+// Prints one frame of a recording and times random access across the file
+static int inspectRecording(const Options& opt) {
+    RecordingReader reader;
+    auto start = std::chrono::steady_clock::now();
+    if (!reader.open(opt.replay)) {
+        std::cerr << "cannot read recording " << opt.replay << "\n";
+        return 1;
+    }
+    double openMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const RecordingHeader& h = reader.header();
+    size_t frames = reader.frameCount();
+    std::cout << "recording:   " << opt.replay << " (" << (h.quantized ? "quantized" : "float") << ", opened in " << openMs << " ms)\n";
+    std::cout << "frames:      " << frames << " (dt " << h.stepSize << ")\n";
+    std::cout << "world:       box " << h.boxSize << ", gravity " << h.globalGravity << ", friction " << h.globalFriction
+              << ", restitution " << h.restitution << ", entropy " << h.entropyLevel << ", seed " << h.seed << "\n";
+    if (frames == 0)
+        return 0;
+    if (opt.frame >= static_cast<long long>(frames)) {
+        std::cerr << "frame " << opt.frame << " out of range\n";
+        return 1;
+    }
+
+    RecordedFrame frame;
+    size_t index = opt.frame < 0 ? frames - 1 : static_cast<size_t>(opt.frame);
+    if (!reader.decode(index, frame)) {
+        std::cerr << "frame " << index << " is corrupt\n";
+        return 1;
+    }
+    double energy = 0;
+    for (size_t i = 0; i < frame.ballCount(); ++i) {
+        float r = frame.radius[i];
+        energy += 0.5 * r * r * r * (frame.vx[i] * frame.vx[i] + frame.vy[i] * frame.vy[i] + frame.vz[i] * frame.vz[i]);
+    }
+    std::cout << "frame:       " << index << " (step " << frame.step << ")\n";
+    std::cout << "balls:       " << frame.ballCount() << "\n";
+    std::cout << "kinetic:     " << energy << " (mass ~ r^3)\n";
+    std::cout << "checksum:    " << std::hex << stateChecksum(frame.px, frame.py, frame.pz) << std::dec << "\n";
+
+    // Scrub: decode frames in a scattered order
+    const size_t seeks = 1000;
+    start = std::chrono::steady_clock::now();
+    size_t f = 0, corrupt = 0;
+    for (size_t k = 0; k < seeks; ++k) {
+        f = (f + 7919) % frames;
+        corrupt += !reader.decode(f, frame);
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / seeks;
+    std::cout << "seek+decode: " << us << " us/frame\n";
+    if (corrupt) {
+        std::cerr << corrupt << " of " << seeks << " seeks hit a corrupt frame\n";
+        return 1;
+    }
+    return 0;
+}
+
+// ------------------ Main Entry Point -------------------
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 1;
+    }
+    if (opt.replay)
+        return inspectRecording(opt);
+
+    World world;
+    world.seed = opt.seed;
+    world.entropyLevel = opt.entropy;
+    world.useSpatialHash = !opt.brute;
+    world.threadCount = opt.threads;
+    world.simdLevel = opt.simd;
+    world.nbodyMode = opt.nbody != 0;
+    world.nbodyDirect = opt.nbody == 2;
+    world.nbodyTheta = opt.theta;
+    world.sleepEnabled = opt.sleep;
+    world.ccdEnabled = opt.ccd;
+    world.solverIterations = opt.iterations;
+    world.warmStart = opt.warmStart;
+    world.trailInterval = opt.trailEvery;
+    world.trailQuantized = opt.trailQuantize;
+    world.timeScale = opt.timeScale;
+
+    // Balls spread through the whole box, which grows when they do not fit
+    SpawnParams spawn;
+    spawn.count = opt.balls;
+    if (opt.radius > 0)
+        spawn.minRadius = spawn.maxRadius = opt.radius;
+    world.boxSize = std::max(world.boxSize, spawnBoxSize(opt.balls, spawn));
+    initWorld(world);
+    SpawnReport setup = spawnBalls(world, spawn);
+
+    Profiler profiler({ "simulation" });
+    if (opt.trace) {
+        profiler.setEnabled(true);
+        world.profiler = profiler.recorder(0);
+    }
+
+    RecordingWriter recording;
+    if (opt.record && !recording.open(opt.record, world, opt.dt, opt.quantize)) {
+        std::cerr << "cannot write " << opt.record << "\n";
+        return 1;
+    }
+
+    size_t sweeps = 0, sweepHits = 0, iterationsUsed = 0;
+    double cacheHitRate = 0, penetration = 0;
+    float worstOverlap = 0;
+    size_t overlappedSteps = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < opt.steps; ++s) {
+        updateSimulation(world, opt.dt * world.timeScale);
+        sweeps += world.ccdSweeps;
+        sweepHits += world.ccdHits;
+        iterationsUsed += world.solverIterationsUsed;
+        cacheHitRate += world.cacheHitRate;
+        penetration += world.residualPenetration;
+        if (opt.checkCcd) {
+            float overlap = deepestOverlap(world.balls);
+            worstOverlap = std::max(worstOverlap, overlap);
+            if (overlap > world.penetrationSlop * overlapAllowance)
+                ++overlappedSteps;
+        }
+        if (opt.trace)
+            profiler.collect();
+        if (opt.record && (s + 1) % opt.recordEvery == 0)
+            recording.capture(world);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "balls:       " << world.balls.size() << " (box " << world.boxSize << ", placed in " << setup.seconds * 1000 << " ms)\n";
+    std::cout << "steps:       " << opt.steps << " (dt " << opt.dt << ", time scale " << world.timeScale << ")\n";
+    std::cout << "broad phase: " << (world.useSpatialHash ? "grid" : "brute") << "\n";
+    std::cout << "threads:     " << world.threadCount << "\n";
+    std::cout << "simd:        " << simdLevelName(resolveSimdLevel(world.simdLevel)) << "\n";
+    std::cout << "n-body:      " << (!world.nbodyMode ? "off" : world.nbodyDirect ? "direct" : "barnes-hut") << "\n";
+    std::cout << "pairs/step:  " << world.pairsTested << "\n";
+    std::cout << "awake:       " << world.balls.size() - world.sleepingBalls << " (" << world.sleepingBalls << " sleeping)\n";
+    std::cout << "solver:      " << (opt.steps ? double(iterationsUsed) / opt.steps : 0.0) << " iterations/step (max " << world.solverIterations
+              << "), cache hits " << (opt.steps ? 100 * cacheHitRate / opt.steps : 0.0) << "%, residual penetration "
+              << (opt.steps ? penetration / opt.steps : 0.0) << " (last step " << world.residualPenetration << ")\n";
+    std::cout << "ccd sweeps:  " << sweeps << " (" << sweepHits << " impacts)\n";
+    std::cout << "live sparks: " << world.sparks.size() << "\n";
+    std::cout << "elapsed:     " << seconds << " s\n";
+    std::cout << "steps/sec:   " << (seconds > 0 ? opt.steps / seconds : 0.0) << "\n";
+    std::cout << "checksum:    " << std::hex << stateChecksum(world.balls.px, world.balls.py, world.balls.pz) << std::dec << "\n";
+
+    if (opt.checkCcd) {
+        std::cout << "overlap:     deepest " << worstOverlap << " (slop " << world.penetrationSlop << "), " << overlappedSteps << " steps past it\n";
+        if (sweepHits == 0 || overlappedSteps > 0) {
+            std::cerr << (sweepHits == 0 ? "ccd check failed: the sweep found no impacts\n" : "ccd check failed: balls ended a step overlapped\n");
+            return 1;
+        }
+    }
+
+    if (opt.record) {
+        if (!recording.close()) {
+            std::cerr << "error writing " << opt.record << "\n";
+            return 1;
+        }
+        std::cout << "recorded:    " << recording.framesWritten() << " frames (" << recording.framesDropped() << " dropped) to " << opt.record << "\n";
+    }
+
+    if (opt.trace) {
+        for (int p = PhaseStep; p <= PhaseSparks; ++p) {
+            PhaseStats s = profiler.stats(static_cast<ProfilePhase>(p));
+            std::cout << phaseName(static_cast<ProfilePhase>(p)) << ": min " << s.minMs << " avg " << s.avgMs << " p99 " << s.p99Ms << " ms\n";
+        }
+        if (!profiler.writeChromeTrace(opt.trace, opt.traceSteps)) {
+            std::cerr << "cannot write " << opt.trace << "\n";
+            return 1;
+        }
+        std::cout << "trace:       " << opt.trace << " (last " << opt.traceSteps << " steps)\n";
+    }
+    return 0;
+}
@@ -0,0 +1,50 @@
+﻿#include "HudText.h"
+
+#include <GL/glut.h>
+#include <algorithm>
+
+bool HudText::changed(size_t line, std::initializer_list<double> key) {
+    if (line >= lines.size())
+        lines.resize(line + 1);
+    if (line >= active) {
+        active = line + 1;
+        drawOrder.clear();
+    }
+    Line& l = lines[line];
+    if (l.built && std::equal(key.begin(), key.end(), l.key.begin(), l.key.end()))
+        return false;
+    l.key.assign(key.begin(), key.end());
+    return true;
+}
+
+void HudText::setText(size_t line, const std::string& text) {
+    Line& l = lines[line];
+    if (!l.list) {
+        l.list = glGenLists(1);
+        drawOrder.clear();
+    }
+    glNewList(l.list, GL_COMPILE);
+    glRasterPos2f(left, top - lineHeight * line);
+    for (char c : text)
+        glutBitmapCharacter(GLUT_BITMAP_8_BY_13, c);
+    glEndList();
+    l.built = true;
+    ++rebuilds;
+}
+
+void HudText::truncate(size_t count) {
+    if (count < active) {
+        active = count;
+        drawOrder.clear();
+    }
+}
+
+void HudText::draw() {
+    // The order only changes when lines come or go, so rebuild it lazily
+    if (drawOrder.empty())
+        for (size_t i = 0; i < active; ++i)
+            if (lines[i].built)
+                drawOrder.push_back(lines[i].list);
+    if (!drawOrder.empty())
+        glCallLists(static_cast<GLsizei>(drawOrder.size()), GL_UNSIGNED_INT, drawOrder.data());
+}
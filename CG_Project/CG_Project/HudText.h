@@ -0,0 +1,41 @@
+﻿#pragma once
+
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// ------------------ Retained HUD Text -------------------
+// Overlay text kept as one display list per line. Each line is keyed by the
+// values it shows; the caller checks the key every frame and only formats and
+// recompiles the line when a value changed. The whole overlay is then drawn
+// with a single glCallLists, so a frame with a steady HUD formats nothing and
+// issues no per-glyph raster calls from the application.
+class HudText {
+public:
+    // Layout in the 800x600 HUD projection set up by renderUI
+    static constexpr float left = 10.0f, top = 580.0f, lineHeight = 15.0f;
+
+    // True when line has not been built or its key differs from the last one;
+    // the caller must then pass the new text to setText
+    bool changed(size_t line, std::initializer_list<double> key);
+    void setText(size_t line, const std::string& text);
+
+    // Drops lines from count on; their display lists are kept for reuse
+    void truncate(size_t count);
+    size_t lineCount() const { return active; }
+
+    // Draws every line with the current colour and projection
+    void draw();
+
+    size_t rebuilds = 0;          // lines recompiled since startup
+
+private:
+    struct Line {
+        std::vector<double> key;
+        unsigned list = 0;
+        bool built = false;
+    };
+    std::vector<Line> lines;
+    std::vector<unsigned> drawOrder;  // display lists of lines [0, active)
+    size_t active = 0;
+};
@@ -0,0 +1,88 @@
+﻿#include "MeshCache.h"
+
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// ------------------ Camera -------------------
+float Camera::depth(float x, float y, float z) const {
+    const float toRad = float(M_PI) / 180.0f;
+    float sa = std::sin(angleX * toRad), ca = std::cos(angleX * toRad);
+    float sb = std::sin(angleY * toRad), cb = std::cos(angleY * toRad);
+    float zy = -sa * x + ca * z;          // after the rotation about y
+    float eyeZ = sb * y + cb * zy - dist; // after the rotation about x and the translation
+    return -eyeZ;
+}
+
+float Camera::focalPixels() const {
+    return 0.5f * viewportHeight / std::tan(0.5f * fovY * float(M_PI) / 180.0f);
+}
+
+float Camera::projectedRadius(float x, float y, float z, float radius) const {
+    float d = depth(x, y, z);
+    if (d <= radius)
+        return 1e9f;
+    return radius * focalPixels() / d;
+}
+
+// ------------------ Mesh Cache -------------------
+// Appends a unit sphere with the given tessellation; the pole rows use one
+// triangle per slice instead of a degenerate quad
+static MeshLevel appendSphere(int slices, int stacks, std::vector<float>& vertices, std::vector<unsigned short>& indices) {
+    MeshLevel level;
+    level.slices = slices;
+    level.stacks = stacks;
+    level.firstIndex = static_cast<int>(indices.size());
+    int base = static_cast<int>(vertices.size() / 3);
+
+    for (int i = 0; i <= stacks; ++i) {
+        float phi = float(M_PI) * i / stacks;
+        for (int j = 0; j <= slices; ++j) {
+            float theta = 2.0f * float(M_PI) * j / slices;
+            vertices.push_back(std::sin(phi) * std::cos(theta));
+            vertices.push_back(std::sin(phi) * std::sin(theta));
+            vertices.push_back(std::cos(phi));
+        }
+    }
+    for (int i = 0; i < stacks; ++i)
+        for (int j = 0; j < slices; ++j) {
+            unsigned short a = static_cast<unsigned short>(base + i * (slices + 1) + j);
+            unsigned short b = static_cast<unsigned short>(a + slices + 1);
+            unsigned short a1 = static_cast<unsigned short>(a + 1), b1 = static_cast<unsigned short>(b + 1);
+            if (i != 0) {
+                unsigned short t[3] = { a, b, a1 };
+                indices.insert(indices.end(), t, t + 3);
+            }
+            if (i != stacks - 1) {
+                unsigned short t[3] = { a1, b, b1 };
+                indices.insert(indices.end(), t, t + 3);
+            }
+        }
+
+    level.indexCount = static_cast<int>(indices.size()) - level.firstIndex;
+    return level;
+}
+
+void MeshCache::build() {
+    // Finest first: the black hole and close-ups, the old glutSolidSphere(16, 16),
+    // then two coarse levels for balls a few pixels across
+    struct Tessellation { int slices, stacks; float minPixels; };
+    const Tessellation table[levelCount] = { { 32, 32, 48.0f }, { 16, 16, 12.0f }, { 10, 8, 4.0f }, { 6, 4, 0.0f } };
+
+    vertices.clear();
+    indices.clear();
+    for (int i = 0; i < levelCount; ++i) {
+        levels[i] = appendSphere(table[i].slices, table[i].stacks, vertices, indices);
+        lodMinPixels[i] = table[i].minPixels;
+    }
+
+    ring.clear();
+    for (int i = 0; i < ringSegments; ++i) {
+        float angle = 2.0f * float(M_PI) * i / ringSegments;
+        ring.push_back(std::cos(angle));
+        ring.push_back(0.0f);
+        ring.push_back(std::sin(angle));
+    }
+}
@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include <vector>
+
+// ------------------ Mesh Cache -------------------
+// Sphere and ring geometry built once at startup. Every sphere level lives in
+// one shared vertex array (unit sphere, positions double as normals) and one
+// index array, so a level is just a range of indices. Level 0 is the finest.
+struct MeshLevel {
+    int slices, stacks;
+    int firstIndex, indexCount;
+    int triangles() const { return indexCount / 3; }
+};
+
+// Camera as set up by renderScene: translate by -dist, rotate angleY about x,
+// then angleX about y; used to estimate how large a ball appears on screen
+struct Camera {
+    float dist = 40.0f;
+    float angleX = 0, angleY = 0;     // degrees
+    float fovY = 45.0f;               // degrees
+    float viewportHeight = 700.0f;    // pixels
+
+    // Distance along the view direction from the eye to a point
+    float depth(float x, float y, float z) const;
+    // Pixels per unit length at unit depth
+    float focalPixels() const;
+    // Radius in pixels of a sphere at (x, y, z); huge when at or behind the eye
+    float projectedRadius(float x, float y, float z, float radius) const;
+};
+
+struct MeshCache {
+    static constexpr int levelCount = 4;
+    static constexpr int ringSegments = 100;
+
+    std::vector<float> vertices;
+    std::vector<unsigned short> indices;
+    MeshLevel levels[levelCount] = {};
+    float lodMinPixels[levelCount] = {};  // smallest projected radius drawn at each level
+    std::vector<float> ring;              // unit circle in the xz plane, ringSegments points
+
+    void build();
+
+    // Coarsest level that still looks round at the given projected radius
+    int levelFor(float pixels) const {
+        int level = 0;
+        while (level + 1 < levelCount && pixels < lodMinPixels[level])
+            ++level;
+        return level;
+    }
+};
@@ -0,0 +1,247 @@
+﻿#include "Octree.h"
+
+#include <algorithm>
+#include <cmath>
+
+static int octant(const Octree::Node& n, float x, float y, float z) {
+    return (x >= n.cx ? 1 : 0) | (y >= n.cy ? 2 : 0) | (z >= n.cz ? 4 : 0);
+}
+
+static void childCell(const Octree::Node& parent, int k, Octree::Node& child) {
+    float h = parent.half * 0.5f;
+    child.half = h;
+    child.cx = parent.cx + ((k & 1) ? h : -h);
+    child.cy = parent.cy + ((k & 2) ? h : -h);
+    child.cz = parent.cz + ((k & 4) ? h : -h);
+}
+
+// Sums mass and centre of mass of a leaf directly from its balls
+static void leafMoments(Octree::Node& n, const BallSystem& balls, const std::vector<int>& order, const std::vector<float>& mass) {
+    float m = 0, x = 0, y = 0, z = 0;
+    for (int k = n.begin; k < n.end; ++k) {
+        int i = order[k];
+        m += mass[i];
+        x += mass[i] * balls.px[i];
+        y += mass[i] * balls.py[i];
+        z += mass[i] * balls.pz[i];
+    }
+    n.mass = m;
+    if (m > 0) {
+        n.mx = x / m;
+        n.my = y / m;
+        n.mz = z / m;
+    }
+}
+
+static void childMoments(Octree::Node& n, const std::vector<Octree::Node>& nodes) {
+    float m = 0, x = 0, y = 0, z = 0;
+    for (int k = 0; k < 8; ++k) {
+        const Octree::Node& c = nodes[n.firstChild + k];
+        m += c.mass;
+        x += c.mass * c.mx;
+        y += c.mass * c.my;
+        z += c.mass * c.mz;
+    }
+    n.mass = m;
+    if (m > 0) {
+        n.mx = x / m;
+        n.my = y / m;
+        n.mz = z / m;
+    }
+}
+
+// Splits order[begin, end) of node `self` into its eight octants, recursing
+// until leaves are small enough. Nodes are appended to `out`.
+static void buildSubtree(std::vector<Octree::Node>& out, int self, int depth, const BallSystem& balls,
+                         std::vector<int>& order, std::vector<int>& scratch, const std::vector<float>& mass) {
+    Octree::Node n = out[self];
+    if (n.end - n.begin <= Octree::leafSize || depth >= Octree::maxDepth) {
+        leafMoments(out[self], balls, order, mass);
+        return;
+    }
+
+    // Counting sort of the node's balls by octant
+    int counts[8] = { 0 };
+    for (int k = n.begin; k < n.end; ++k) {
+        int i = order[k];
+        ++counts[octant(n, balls.px[i], balls.py[i], balls.pz[i])];
+    }
+    int starts[9];
+    starts[0] = n.begin;
+    for (int k = 0; k < 8; ++k)
+        starts[k + 1] = starts[k] + counts[k];
+    int fill[8];
+    std::copy(starts, starts + 8, fill);
+    for (int k = n.begin; k < n.end; ++k) {
+        int i = order[k];
+        scratch[fill[octant(n, balls.px[i], balls.py[i], balls.pz[i])]++] = i;
+    }
+    std::copy(scratch.begin() + n.begin, scratch.begin() + n.end, order.begin() + n.begin);
+
+    int first = static_cast<int>(out.size());
+    out[self].firstChild = first;
+    for (int k = 0; k < 8; ++k) {
+        Octree::Node c;
+        childCell(n, k, c);
+        c.begin = starts[k];
+        c.end = starts[k + 1];
+        out.push_back(c);
+    }
+    for (int k = 0; k < 8; ++k)
+        buildSubtree(out, first + k, depth + 1, balls, order, scratch, mass);
+    childMoments(out[self], out);
+}
+
+void Octree::build(const BallSystem& balls, float boxSize, ThreadPool& pool) {
+    const int side = 1 << topLevels;            // buckets per axis
+    const int bucketCount = side * side * side;
+    size_t n = balls.size();
+
+    mass.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        mass[i] = 1.0f / balls.invMass[i];
+
+    // Top levels: root, its eight children, and their 64 children (the bucket roots)
+    nodes.assign(1 + 8 + bucketCount, Node());
+    nodes[0].half = boxSize;
+    nodes[0].firstChild = 1;
+    for (int k = 0; k < 8; ++k) {
+        childCell(nodes[0], k, nodes[1 + k]);
+        nodes[1 + k].firstChild = 9 + 8 * k;
+        for (int j = 0; j < 8; ++j)
+            childCell(nodes[1 + k], j, nodes[9 + 8 * k + j]);
+    }
+
+    // Bucket every ball by its level-2 cell (clamped, so strays land at the edge)
+    auto bucketOf = [&](size_t i) {
+        int c[3];
+        const float p[3] = { balls.px[i], balls.py[i], balls.pz[i] };
+        for (int a = 0; a < 3; ++a) {
+            int v = static_cast<int>((p[a] + boxSize) / (2.0f * boxSize) * side);
+            c[a] = std::max(0, std::min(side - 1, v));
+        }
+        int k = (c[0] >> 1) | ((c[1] >> 1) << 1) | ((c[2] >> 1) << 2);   // level-1 octant
+        int j = (c[0] & 1) | ((c[1] & 1) << 1) | ((c[2] & 1) << 2);      // octant within it
+        return 8 * k + j;
+    };
+    std::vector<int> bucket(n);
+    pool.parallelFor(n, 4096, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i)
+            bucket[i] = bucketOf(i);
+    });
+
+    std::vector<int> starts(bucketCount + 1, 0);
+    for (size_t i = 0; i < n; ++i)
+        ++starts[bucket[i] + 1];
+    for (int b = 0; b < bucketCount; ++b)
+        starts[b + 1] += starts[b];
+    order.resize(n);
+    std::vector<int> fill(starts.begin(), starts.end() - 1);
+    for (size_t i = 0; i < n; ++i)
+        order[fill[bucket[i]]++] = static_cast<int>(i);
+
+    // Build each bucket's subtree on its own node list
+    std::vector<std::vector<Node>> subtrees(bucketCount);
+    std::vector<int> scratch(n);
+    pool.parallelFor(bucketCount, 1, [&](size_t begin, size_t end, size_t) {
+        for (size_t b = begin; b < end; ++b) {
+            Node root = nodes[9 + b];
+            root.begin = starts[b];
+            root.end = starts[b + 1];
+            std::vector<Node>& out = subtrees[b];
+            out.assign(1, root);
+            buildSubtree(out, 0, topLevels, balls, order, scratch, mass);
+        }
+    });
+
+    // Splice: each subtree root takes its bucket slot, the rest is appended
+    std::vector<int> base(bucketCount + 1);
+    base[0] = static_cast<int>(nodes.size());
+    for (int b = 0; b < bucketCount; ++b)
+        base[b + 1] = base[b] + static_cast<int>(subtrees[b].size()) - 1;
+    nodes.resize(base[bucketCount]);
+    pool.parallelFor(bucketCount, 1, [&](size_t begin, size_t end, size_t) {
+        for (size_t b = begin; b < end; ++b) {
+            const std::vector<Node>& sub = subtrees[b];
+            auto remap = [&](Node nd) {
+                if (nd.firstChild > 0)
+                    nd.firstChild = base[b] + nd.firstChild - 1;
+                return nd;
+            };
+            nodes[9 + b] = remap(sub[0]);
+            for (size_t k = 1; k < sub.size(); ++k)
+                nodes[base[b] + k - 1] = remap(sub[k]);
+        }
+    });
+
+    for (int k = 0; k < 8; ++k)
+        childMoments(nodes[1 + k], nodes);
+    childMoments(nodes[0], nodes);
+}
+
+Vec3 Octree::acceleration(const BallSystem& balls, size_t i, float theta, float G, float softening) const {
+    float x = balls.px[i], y = balls.py[i], z = balls.pz[i];
+    float eps2 = softening * softening;
+    float theta2 = theta * theta;
+    float ax = 0, ay = 0, az = 0;
+
+    int stack[8 * maxDepth + 8];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& n = nodes[stack[--top]];
+        if (n.mass <= 0)
+            continue;
+
+        float dx = n.mx - x, dy = n.my - y, dz = n.mz - z;
+        float d2 = dx * dx + dy * dy + dz * dz;
+        float size = 2.0f * n.half;
+
+        if (n.firstChild >= 0 && size * size >= theta2 * d2) {
+            for (int k = 0; k < 8; ++k)
+                stack[top++] = n.firstChild + k;
+            continue;
+        }
+
+        if (n.firstChild < 0) {
+            // Leaf: sum its balls directly, skipping ourselves
+            for (int k = n.begin; k < n.end; ++k) {
+                int j = order[k];
+                if (size_t(j) == i)
+                    continue;
+                float ex = balls.px[j] - x, ey = balls.py[j] - y, ez = balls.pz[j] - z;
+                float r2 = ex * ex + ey * ey + ez * ez + eps2;
+                float s = G * mass[j] / (r2 * std::sqrt(r2));
+                ax += ex * s;
+                ay += ey * s;
+                az += ez * s;
+            }
+            continue;
+        }
+
+        // Far enough away: the whole node acts as one point mass
+        float r2 = d2 + eps2;
+        float s = G * n.mass / (r2 * std::sqrt(r2));
+        ax += dx * s;
+        ay += dy * s;
+        az += dz * s;
+    }
+    return Vec3(ax, ay, az);
+}
+
+Vec3 directAcceleration(const BallSystem& balls, size_t i, float G, float softening) {
+    float x = balls.px[i], y = balls.py[i], z = balls.pz[i];
+    float eps2 = softening * softening;
+    float ax = 0, ay = 0, az = 0;
+    for (size_t j = 0; j < balls.size(); ++j) {
+        if (j == i)
+            continue;
+        float ex = balls.px[j] - x, ey = balls.py[j] - y, ez = balls.pz[j] - z;
+        float r2 = ex * ex + ey * ey + ez * ez + eps2;
+        float s = G / balls.invMass[j] / (r2 * std::sqrt(r2));
+        ax += ex * s;
+        ay += ey * s;
+        az += ez * s;
+    }
+    return Vec3(ax, ay, az);
+}
@@ -0,0 +1,40 @@
+﻿#pragma once
+
+#include <vector>
+
+#include "BallSystem.h"
+#include "ThreadPool.h"
+
+// ------------------ Barnes-Hut Octree -------------------
+// Octree over the box for mutual ball-to-ball gravity. It is rebuilt every
+// step: balls are bucketed into the 64 cells of the first two levels, each
+// bucket's subtree is built in parallel by recursive partitioning, and the
+// subtrees are then spliced into one node array. Traversal is also parallel,
+// one ball per task: a node whose size / distance falls below the opening
+// angle theta is treated as a single point mass at its centre of mass.
+struct Octree {
+    static constexpr int leafSize = 8;    // most balls kept in a leaf
+    static constexpr int maxDepth = 24;   // deeper nodes become leaves regardless of count
+    static constexpr int topLevels = 2;   // levels built serially; 8^2 = 64 parallel buckets
+
+    struct Node {
+        float mx = 0, my = 0, mz = 0;     // centre of mass
+        float mass = 0;
+        float cx = 0, cy = 0, cz = 0;     // cell centre
+        float half = 0;                   // cell half-size
+        int firstChild = -1;              // eight consecutive children, or -1 for a leaf
+        int begin = 0, end = 0;           // leaf balls: order[begin, end)
+    };
+
+    std::vector<Node> nodes;              // nodes[0] is the root
+    std::vector<int> order;               // ball indices grouped by leaf
+    std::vector<float> mass;              // per-ball mass, 1 / invMass
+
+    void build(const BallSystem& balls, float boxSize, ThreadPool& pool);
+
+    // Barnes-Hut acceleration of ball i
+    Vec3 acceleration(const BallSystem& balls, size_t i, float theta, float G, float softening) const;
+};
+
+// Direct O(n) summation over every other ball; the reference for Barnes-Hut
+Vec3 directAcceleration(const BallSystem& balls, size_t i, float G, float softening);
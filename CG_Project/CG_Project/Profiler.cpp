@@ -0,0 +1,160 @@
+﻿#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+const char* phaseName(ProfilePhase phase) {
+    static const char* names[PhaseCount] = { "step", "integrate", "collisions", "sleep", "sparks",
+                                             "frame", "draw balls", "draw effects", "hud" };
+    return names[phase];
+}
+
+uint64_t profileNow() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// ------------------ Recorder -------------------
+void ProfileRecorder::record(ProfilePhase phase, uint64_t startNs, uint64_t endNs) {
+    ProfileEvent e;
+    e.startNs = startNs;
+    e.durationNs = static_cast<uint32_t>(std::min<uint64_t>(endNs - startNs, UINT32_MAX));
+    e.phase = static_cast<uint16_t>(phase);
+    e.thread = thread;
+    if (!events.push(e))
+        dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ProfileRecorder::count(size_t balls, size_t pairs, size_t contacts, size_t sparks) {
+    if (!active())
+        return;
+    ProfileCounters c;
+    c.timeNs = profileNow();
+    c.balls = static_cast<uint32_t>(balls);
+    c.pairs = static_cast<uint32_t>(pairs);
+    c.contacts = static_cast<uint32_t>(contacts);
+    c.sparks = static_cast<uint32_t>(sparks);
+    counters.push(c);
+}
+
+// ------------------ Profiler -------------------
+Profiler::Profiler(const std::vector<std::string>& threadNames) : names(threadNames) {
+    for (size_t t = 0; t < threadNames.size(); ++t) {
+        recorders.emplace_back(new ProfileRecorder());
+        recorders.back()->thread = static_cast<uint16_t>(t);
+    }
+    history.resize(historyEvents);
+    counterHistory.resize(historyCounters);
+    for (std::vector<float>& s : samples)
+        s.resize(window);
+}
+
+void Profiler::setEnabled(bool on) {
+    for (auto& r : recorders)
+        r->enabled.store(on, std::memory_order_relaxed);
+}
+
+void Profiler::collect() {
+    for (auto& r : recorders) {
+        ProfileEvent e;
+        while (r->events.pop(e)) {
+            history[historyCount++ % historyEvents] = e;
+            samples[e.phase][sampleCount[e.phase]++ % window] = e.durationNs * 1e-6f;
+        }
+        ProfileCounters c;
+        while (r->counters.pop(c))
+            counterHistory[counterCount++ % historyCounters] = c;
+    }
+}
+
+PhaseStats Profiler::stats(ProfilePhase phase) const {
+    PhaseStats s;
+    s.samples = std::min(sampleCount[phase], window);
+    if (s.samples == 0)
+        return s;
+    std::vector<float> sorted(samples[phase].begin(), samples[phase].begin() + s.samples);
+    std::sort(sorted.begin(), sorted.end());
+    s.minMs = sorted.front();
+    float sum = 0;
+    for (float v : sorted)
+        sum += v;
+    s.avgMs = sum / s.samples;
+    s.p99Ms = sorted[std::min(s.samples - 1, s.samples * 99 / 100)];
+    return s;
+}
+
+size_t Profiler::dropped() const {
+    size_t total = 0;
+    for (const auto& r : recorders)
+        total += r->dropped.load(std::memory_order_relaxed);
+    return total;
+}
+
+// ------------------ Chrome Trace -------------------
+// Complete ("X") events per phase and one counter ("C") track per step, in
+// the JSON object format chrome://tracing and Perfetto load
+bool Profiler::writeChromeTrace(const std::string& path, size_t frames) const {
+    size_t held = std::min(historyCount, historyEvents);
+    size_t first = historyCount - held;
+    auto at = [&](size_t k) -> const ProfileEvent& { return history[k % historyEvents]; };
+
+    // Walk back to the start of the frames-th most recent frame
+    bool anyFrame = false;
+    for (size_t k = first; k < historyCount && !anyFrame; ++k)
+        anyFrame = at(k).phase == PhaseFrame;
+    uint16_t boundary = anyFrame ? PhaseFrame : PhaseStep;
+    uint64_t cutoff = 0;
+    size_t seen = 0;
+    for (size_t k = historyCount; k > first && seen < frames; --k)
+        if (at(k - 1).phase == boundary) {
+            cutoff = at(k - 1).startNs;
+            ++seen;
+        }
+
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    // Timestamps are relative to the earliest exported sample
+    size_t heldCounters = std::min(counterCount, historyCounters);
+    size_t firstCounter = counterCount - heldCounters;
+    auto counterAt = [&](size_t k) -> const ProfileCounters& { return counterHistory[k % historyCounters]; };
+    uint64_t origin = UINT64_MAX;
+    for (size_t k = first; k < historyCount; ++k)
+        if (at(k).startNs >= cutoff)
+            origin = std::min(origin, at(k).startNs);
+    for (size_t k = firstCounter; k < counterCount; ++k)
+        if (counterAt(k).timeNs >= cutoff)
+            origin = std::min(origin, counterAt(k).timeNs);
+
+    file << "{\n  \"displayTimeUnit\": \"ms\",\n  \"traceEvents\": [\n";
+    bool firstLine = true;
+    auto line = [&]() -> std::ofstream& {
+        file << (firstLine ? "    " : ",\n    ");
+        firstLine = false;
+        return file;
+    };
+    for (size_t t = 0; t < names.size(); ++t)
+        line() << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << t
+               << ", \"args\": { \"name\": \"" << names[t] << "\" } }";
+    file.setf(std::ios::fixed);
+    file.precision(3);
+    for (size_t k = first; k < historyCount; ++k) {
+        const ProfileEvent& e = at(k);
+        if (e.startNs < cutoff)
+            continue;
+        line() << "{ \"name\": \"" << phaseName(static_cast<ProfilePhase>(e.phase)) << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.thread
+               << ", \"ts\": " << (e.startNs - origin) * 1e-3 << ", \"dur\": " << e.durationNs * 1e-3 << " }";
+    }
+    for (size_t k = firstCounter; k < counterCount; ++k) {
+        const ProfileCounters& c = counterAt(k);
+        if (c.timeNs < cutoff)
+            continue;
+        line() << "{ \"name\": \"world\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << (c.timeNs - origin) * 1e-3
+               << ", \"args\": { \"balls\": " << c.balls << ", \"candidate pairs\": " << c.pairs
+               << ", \"contacts\": " << c.contacts << ", \"sparks\": " << c.sparks << " } }";
+    }
+    file << "\n  ]\n}\n";
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,117 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SpscQueue.h"
+
+// ------------------ Profiler -------------------
+// Scoped timers around the phases of a step and a frame. Each producing
+// thread owns a ProfileRecorder whose events travel through lock-free queues
+// to the thread that owns the Profiler, which keeps a ring of recent events
+// for trace export and a rolling window per phase for min/avg/p99. While
+// profiling is off a scope costs one relaxed load.
+enum ProfilePhase {
+    PhaseStep,            // one updateSimulation call
+    PhaseIntegrate,
+    PhaseCollisions,
+    PhaseSleep,
+    PhaseSparks,          // spark integration and expiry
+    PhaseFrame,           // one rendered frame, including the buffer swap
+    PhaseDrawBalls,
+    PhaseDrawEffects,     // trails and sparks
+    PhaseHud,
+    PhaseCount
+};
+
+const char* phaseName(ProfilePhase phase);
+
+// Nanoseconds on the steady clock
+uint64_t profileNow();
+
+struct ProfileEvent {
+    uint64_t startNs;
+    uint32_t durationNs;
+    uint16_t phase;
+    uint16_t thread;
+};
+
+// Sampled once per simulation step
+struct ProfileCounters {
+    uint64_t timeNs;
+    uint32_t balls, pairs, contacts, sparks;
+};
+
+struct ProfileRecorder {
+    std::atomic<bool> enabled{ false };
+    uint16_t thread = 0;
+    SpscQueue<ProfileEvent, 8192> events;
+    SpscQueue<ProfileCounters, 1024> counters;
+    std::atomic<size_t> dropped{ 0 };   // events lost to a full queue
+
+    bool active() const { return enabled.load(std::memory_order_relaxed); }
+    void record(ProfilePhase phase, uint64_t startNs, uint64_t endNs);
+    void count(size_t balls, size_t pairs, size_t contacts, size_t sparks);
+};
+
+class ProfileScope {
+public:
+    ProfileScope(ProfileRecorder* recorder, ProfilePhase phase)
+        : rec(recorder && recorder->active() ? recorder : nullptr), phase(phase), start(rec ? profileNow() : 0) {}
+    ~ProfileScope() {
+        if (rec)
+            rec->record(phase, start, profileNow());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    ProfileRecorder* rec;
+    ProfilePhase phase;
+    uint64_t start;
+};
+
+struct PhaseStats {
+    float minMs = 0, avgMs = 0, p99Ms = 0;
+    size_t samples = 0;
+};
+
+class Profiler {
+public:
+    static constexpr size_t historyEvents = 1 << 16;
+    static constexpr size_t historyCounters = 1 << 14;
+    static constexpr size_t window = 240;      // samples per phase behind min/avg/p99
+
+    // One recorder per producing thread; thread 0 is the owning thread
+    explicit Profiler(const std::vector<std::string>& threadNames);
+
+    ProfileRecorder* recorder(int thread) { return recorders[thread].get(); }
+    void setEnabled(bool on);
+    bool enabled() const { return recorders[0]->active(); }
+
+    // Drains every recorder; call regularly from the owning thread
+    void collect();
+
+    PhaseStats stats(ProfilePhase phase) const;
+    size_t dropped() const;
+
+    // Writes the last `frames` frames (steps when nothing drew a frame) of
+    // events and counters as Chrome trace JSON; returns false if the file
+    // cannot be written
+    bool writeChromeTrace(const std::string& path, size_t frames) const;
+
+private:
+    std::vector<std::unique_ptr<ProfileRecorder>> recorders;
+    std::vector<std::string> names;
+
+    std::vector<ProfileEvent> history;         // ring, historyEvents entries
+    size_t historyCount = 0;
+    std::vector<ProfileCounters> counterHistory;
+    size_t counterCount = 0;
+    std::vector<float> samples[PhaseCount];    // ring of recent durations in ms
+    size_t sampleCount[PhaseCount] = {};
+};
@@ -0,0 +1,296 @@
+﻿#include "Recording.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char headerMagic[8] = { 'G', 'B', 'R', 'E', 'C', '0', '1', 0 };
+static const char footerMagic[8] = { 'G', 'B', 'R', 'E', 'C', 'E', 'N', 'D' };
+static const uint32_t formatVersion = 1;
+
+static uint64_t padded(uint64_t bytes) { return (bytes + 7) & ~uint64_t(7); }
+
+// Bytes of one frame including its header
+static uint64_t frameBytes(uint64_t balls, bool quantized) {
+    uint64_t value = quantized ? sizeof(int16_t) : sizeof(float);
+    return sizeof(RecordingFrameHeader) + padded(7 * value * balls + 3 * balls);
+}
+
+static int16_t quantize(float v, float scale) {
+    float q = scale > 0 ? std::round(v / scale * 32767.0f) : 0.0f;
+    return static_cast<int16_t>(std::max(-32767.0f, std::min(32767.0f, q)));
+}
+
+static uint8_t channel(float c) { return static_cast<uint8_t>(std::max(0.0f, std::min(1.0f, c)) * 255.0f + 0.5f); }
+
+// ------------------ Recording Writer -------------------
+bool RecordingWriter::open(const std::string& path, const World& world, float stepSize, bool quantize) {
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    RecordingHeader h = {};
+    memcpy(h.magic, headerMagic, sizeof(h.magic));
+    h.version = formatVersion;
+    h.quantized = quantize ? 1 : 0;
+    h.seed = world.seed;
+    h.boxSize = world.boxSize;
+    h.globalGravity = world.globalGravity;
+    h.globalFriction = world.globalFriction;
+    h.restitution = world.restitution;
+    h.entropyLevel = world.entropyLevel;
+    h.timeScale = world.timeScale;
+    h.stepSize = stepSize;
+    if (fwrite(&h, sizeof(h), 1, file) != 1) {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+
+    quantized = quantize;
+    boxSize = world.boxSize;
+    offsets.clear();
+    offset = sizeof(h);
+    ioError = false;
+    written = 0;
+    dropped = 0;
+    running = true;
+    thread = std::thread(&RecordingWriter::run, this);
+    return true;
+}
+
+void RecordingWriter::capture(const World& world) {
+    if (!file)
+        return;
+    Buffer* buffer = nullptr;
+    if (!spare.pop(buffer)) {
+        if (buffers.size() == maxBuffers) {
+            ++dropped;
+            return;
+        }
+        buffers.emplace_back(new Buffer());
+        buffer = buffers.back().get();
+    }
+
+    const BallSystem& balls = world.balls;
+    size_t n = balls.size();
+    buffer->assign(static_cast<size_t>(frameBytes(n, quantized)), 0);
+
+    RecordingFrameHeader fh = {};
+    fh.step = world.stepCount;
+    fh.ballCount = static_cast<uint32_t>(n);
+    for (size_t i = 0; i < n; ++i) {
+        fh.velocityScale = std::max({ fh.velocityScale, std::fabs(balls.vx[i]), std::fabs(balls.vy[i]), std::fabs(balls.vz[i]) });
+        fh.radiusScale = std::max(fh.radiusScale, balls.radius[i]);
+    }
+    memcpy(buffer->data(), &fh, sizeof(fh));
+
+    unsigned char* p = buffer->data() + sizeof(fh);
+    const std::vector<float>* arrays[7] = { &balls.px, &balls.py, &balls.pz, &balls.vx, &balls.vy, &balls.vz, &balls.radius };
+    float scales[7] = { boxSize, boxSize, boxSize, fh.velocityScale, fh.velocityScale, fh.velocityScale, fh.radiusScale };
+    for (int a = 0; a < 7; ++a) {
+        const std::vector<float>& src = *arrays[a];
+        if (quantized) {
+            int16_t* dst = reinterpret_cast<int16_t*>(p);
+            for (size_t i = 0; i < n; ++i)
+                dst[i] = quantize(src[i], scales[a]);
+            p += n * sizeof(int16_t);
+        }
+        else {
+            memcpy(p, src.data(), n * sizeof(float));
+            p += n * sizeof(float);
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        p[i] = channel(balls.color[i].r);
+        p[n + i] = channel(balls.color[i].g);
+        p[2 * n + i] = channel(balls.color[i].b);
+    }
+
+    // Never fails: there are at most maxBuffers buffers in flight
+    filled.push(buffer);
+}
+
+void RecordingWriter::drain() {
+    Buffer* buffer = nullptr;
+    while (filled.pop(buffer)) {
+        if (!ioError && fwrite(buffer->data(), 1, buffer->size(), file) != buffer->size())
+            ioError = true;
+        offsets.push_back(offset);
+        offset += buffer->size();
+        written.fetch_add(1, std::memory_order_relaxed);
+        spare.push(buffer);
+    }
+}
+
+void RecordingWriter::run() {
+    while (running.load(std::memory_order_acquire)) {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // Frames queued just before close() was called
+    drain();
+}
+
+bool RecordingWriter::close() {
+    if (!file)
+        return true;
+    running.store(false, std::memory_order_release);
+    thread.join();
+
+    RecordingFooter footer = {};
+    footer.indexOffset = offset;
+    footer.frameCount = offsets.size();
+    memcpy(footer.magic, footerMagic, sizeof(footer.magic));
+    bool ok = !ioError &&
+        fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size() &&
+        fwrite(&footer, sizeof(footer), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    return ok;
+}
+
+// ------------------ Recording Reader -------------------
+bool RecordingReader::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE)
+        return false;
+    fileHandle = f;
+    LARGE_INTEGER length;
+    if (!GetFileSizeEx(f, &length) || length.QuadPart == 0) {
+        close();
+        return false;
+    }
+    size = static_cast<size_t>(length.QuadPart);
+    mapping = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        close();
+        return false;
+    }
+    data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close();
+        return false;
+    }
+    size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    data = map == MAP_FAILED ? nullptr : static_cast<const unsigned char*>(map);
+#endif
+    if (!data) {
+        close();
+        return false;
+    }
+
+    // Validate the header, the footer and the offset table; frames are checked
+    // as they are read, so opening touches no page outside the two ends
+    RecordingFooter footer;
+    bool ok = size >= sizeof(RecordingHeader) + sizeof(RecordingFooter) &&
+              memcmp(header().magic, headerMagic, sizeof(headerMagic)) == 0 && header().version == formatVersion;
+    if (ok) {
+        memcpy(&footer, data + size - sizeof(footer), sizeof(footer));
+        // Ordered so no sum or product can wrap
+        uint64_t tableEnd = size - sizeof(footer);
+        ok = memcmp(footer.magic, footerMagic, sizeof(footerMagic)) == 0 &&
+             footer.indexOffset % 8 == 0 &&
+             footer.indexOffset >= sizeof(RecordingHeader) && footer.indexOffset <= tableEnd &&
+             footer.frameCount == (tableEnd - footer.indexOffset) / sizeof(uint64_t) &&
+             (tableEnd - footer.indexOffset) % sizeof(uint64_t) == 0;
+    }
+    if (!ok) {
+        close();
+        return false;
+    }
+    offsets = reinterpret_cast<const uint64_t*>(data + footer.indexOffset);
+    frames = static_cast<size_t>(footer.frameCount);
+    framesEnd = footer.indexOffset;
+    return true;
+}
+
+void RecordingReader::close() {
+#ifdef _WIN32
+    if (data)
+        UnmapViewOfFile(data);
+    if (mapping)
+        CloseHandle(mapping);
+    if (fileHandle)
+        CloseHandle(fileHandle);
+    mapping = fileHandle = nullptr;
+#else
+    if (data)
+        munmap(const_cast<unsigned char*>(data), size);
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+#endif
+    data = nullptr;
+    size = 0;
+    offsets = nullptr;
+    frames = 0;
+    framesEnd = 0;
+}
+
+const RecordingFrameHeader* RecordingReader::frameHeader(size_t frame) const {
+    if (frame >= frames)
+        return nullptr;
+    uint64_t offset = offsets[frame];
+    if (offset % 8 != 0 || offset < sizeof(RecordingHeader) || offset > framesEnd ||
+        framesEnd - offset < sizeof(RecordingFrameHeader))
+        return nullptr;
+    const RecordingFrameHeader* fh = reinterpret_cast<const RecordingFrameHeader*>(data + offset);
+    uint64_t bytes = frameBytes(fh->ballCount, header().quantized != 0);
+    return bytes <= framesEnd - offset ? fh : nullptr;
+}
+
+bool RecordingReader::decode(size_t frame, RecordedFrame& out) const {
+    const RecordingFrameHeader* checked = frameHeader(frame);
+    if (!checked)
+        return false;
+    const RecordingFrameHeader& fh = *checked;
+    size_t n = fh.ballCount;
+    bool quantized = header().quantized != 0;
+    float box = header().boxSize;
+    out.step = fh.step;
+
+    const unsigned char* p = data + offsets[frame] + sizeof(RecordingFrameHeader);
+    std::vector<float>* arrays[7] = { &out.px, &out.py, &out.pz, &out.vx, &out.vy, &out.vz, &out.radius };
+    float scales[7] = { box, box, box, fh.velocityScale, fh.velocityScale, fh.velocityScale, fh.radiusScale };
+    for (int a = 0; a < 7; ++a) {
+        std::vector<float>& dst = *arrays[a];
+        dst.resize(n);
+        if (quantized) {
+            const int16_t* src = reinterpret_cast<const int16_t*>(p);
+            float scale = scales[a] / 32767.0f;
+            for (size_t i = 0; i < n; ++i)
+                dst[i] = src[i] * scale;
+            p += n * sizeof(int16_t);
+        }
+        else {
+            memcpy(dst.data(), p, n * sizeof(float));
+            p += n * sizeof(float);
+        }
+    }
+    out.color.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        out.color[i] = { p[i] / 255.0f, p[n + i] / 255.0f, p[2 * n + i] / 255.0f };
+    return true;
+}
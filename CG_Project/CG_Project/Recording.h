@@ -0,0 +1,141 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SpscQueue.h"
+#include "World.h"
+
+// ------------------ Recording Format -------------------
+// [RecordingHeader] [frame 0] [frame 1] ... [uint64 offset of each frame] [RecordingFooter]
+//
+// A frame is a RecordingFrameHeader followed by per-ball arrays: px py pz vx
+// vy vz radius, each float32 or, in a quantized file, int16; then r g b as
+// uint8, padded to 8 bytes. Quantized positions are fractions of boxSize,
+// velocities and radii fractions of per-frame scales kept in the frame header.
+// The offset table at the end gives O(1) access to any frame.
+struct RecordingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t quantized;
+    uint64_t seed;
+    float boxSize, globalGravity, globalFriction, restitution, entropyLevel, timeScale;
+    float stepSize;               // simulated seconds per physics step
+    uint32_t reserved;
+};
+
+struct RecordingFrameHeader {
+    uint64_t step;
+    uint32_t ballCount;
+    float velocityScale;
+    float radiusScale;
+    uint32_t reserved;
+};
+
+struct RecordingFooter {
+    uint64_t indexOffset;
+    uint64_t frameCount;
+    char magic[8];
+};
+
+static_assert(sizeof(RecordingHeader) == 56, "header layout is part of the file format");
+static_assert(sizeof(RecordingFrameHeader) == 24, "frame header layout is part of the file format");
+static_assert(sizeof(RecordingFooter) == 24, "footer layout is part of the file format");
+
+// One decoded frame
+struct RecordedFrame {
+    uint64_t step = 0;
+    std::vector<float> px, py, pz, vx, vy, vz, radius;
+    std::vector<Color> color;
+
+    size_t ballCount() const { return px.size(); }
+};
+
+// ------------------ Recording Writer -------------------
+// capture() encodes the balls into a pooled buffer on the calling thread and
+// hands it to a background thread that does the file I/O, so a slow disk never
+// stalls the simulation. When every buffer is still queued the frame is
+// dropped and counted instead.
+class RecordingWriter {
+public:
+    static constexpr size_t maxBuffers = 64;
+
+    ~RecordingWriter() { close(); }
+
+    bool open(const std::string& path, const World& world, float stepSize, bool quantized);
+    bool isOpen() const { return file != nullptr; }
+
+    // Producer side; call from one thread only
+    void capture(const World& world);
+
+    // Writes every queued frame, the offset table and the footer; returns false on an I/O error
+    bool close();
+
+    size_t framesWritten() const { return written.load(std::memory_order_relaxed); }
+    size_t framesDropped() const { return dropped; }
+
+private:
+    using Buffer = std::vector<unsigned char>;
+
+    void run();
+    void drain();
+
+    FILE* file = nullptr;
+    bool quantized = false;
+    float boxSize = 1.0f;
+    std::thread thread;
+    std::atomic<bool> running{ false };
+    SpscQueue<Buffer*, maxBuffers> filled;   // producer -> writer
+    SpscQueue<Buffer*, maxBuffers> spare;    // writer -> producer
+    std::vector<std::unique_ptr<Buffer>> buffers;  // every buffer ever allocated, owned by the producer
+    size_t dropped = 0;
+
+    // Writer thread only
+    std::vector<uint64_t> offsets;
+    uint64_t offset = 0;
+    bool ioError = false;
+    std::atomic<size_t> written{ 0 };
+};
+
+// ------------------ Recording Reader -------------------
+// Maps the whole file read-only; frames are decoded straight from the mapping,
+// so opening a recording of any size costs only the footer and table bounds
+// check. Each frame is validated when it is read.
+class RecordingReader {
+public:
+    RecordingReader() = default;
+    ~RecordingReader() { close(); }
+
+    RecordingReader(const RecordingReader&) = delete;
+    RecordingReader& operator=(const RecordingReader&) = delete;
+
+    // Returns false if the file is missing, truncated or not a recording
+    bool open(const std::string& path);
+    void close();
+
+    const RecordingHeader& header() const { return *reinterpret_cast<const RecordingHeader*>(data); }
+    size_t frameCount() const { return frames; }
+
+    // Both return null / false, leaving out untouched, for a frame whose
+    // offset or ball count does not fit the file
+    const RecordingFrameHeader* frameHeader(size_t frame) const;
+    bool decode(size_t frame, RecordedFrame& out) const;
+
+private:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    const uint64_t* offsets = nullptr;
+    size_t frames = 0;
+    uint64_t framesEnd = 0;     // offset of the table; every frame ends at or before it
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
@@ -0,0 +1,535 @@
+﻿#include "Renderer.h"
+
+#include <GL/glut.h>
+#include <cstddef>
+#include <cstdlib>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+// ------------------ GL Entry Points -------------------
+// Constants and functions beyond GL 1.1, declared here so the renderer does
+// not depend on glext.h or an extension loader
+#define GL_ARRAY_BUFFER_ 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER_ 0x8893
+#define GL_STREAM_DRAW_ 0x88E0
+#define GL_STATIC_DRAW_ 0x88E4
+#define GL_FRAGMENT_SHADER_ 0x8B30
+#define GL_VERTEX_SHADER_ 0x8B31
+#define GL_COMPILE_STATUS_ 0x8B81
+#define GL_LINK_STATUS_ 0x8B82
+#define GL_VERTEX_PROGRAM_POINT_SIZE_ 0x8642
+#define GL_POINT_SPRITE_ 0x8861
+
+namespace gl {
+typedef void (APIENTRY* GenBuffers)(GLsizei, GLuint*);
+typedef void (APIENTRY* BindBuffer)(GLenum, GLuint);
+typedef void (APIENTRY* BufferData)(GLenum, ptrdiff_t, const void*, GLenum);
+typedef GLuint (APIENTRY* CreateShader)(GLenum);
+typedef void (APIENTRY* ShaderSource)(GLuint, GLsizei, const char* const*, const GLint*);
+typedef void (APIENTRY* CompileShader)(GLuint);
+typedef void (APIENTRY* GetShaderiv)(GLuint, GLenum, GLint*);
+typedef GLuint (APIENTRY* CreateProgram)();
+typedef void (APIENTRY* AttachShader)(GLuint, GLuint);
+typedef void (APIENTRY* BindAttribLocation)(GLuint, GLuint, const char*);
+typedef void (APIENTRY* LinkProgram)(GLuint);
+typedef void (APIENTRY* GetProgramiv)(GLuint, GLenum, GLint*);
+typedef void (APIENTRY* UseProgram)(GLuint);
+typedef GLint (APIENTRY* GetUniformLocation)(GLuint, const char*);
+typedef void (APIENTRY* Uniform1f)(GLint, GLfloat);
+typedef void (APIENTRY* EnableVertexAttribArray)(GLuint);
+typedef void (APIENTRY* DisableVertexAttribArray)(GLuint);
+typedef void (APIENTRY* VertexAttribPointer)(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*);
+typedef void (APIENTRY* VertexAttribDivisor)(GLuint, GLuint);
+typedef void (APIENTRY* DrawElementsInstanced)(GLenum, GLsizei, GLenum, const void*, GLsizei);
+typedef void (APIENTRY* MultiDrawArrays)(GLenum, const GLint*, const GLsizei*, GLsizei);
+
+static GenBuffers genBuffers;
+static BindBuffer bindBuffer;
+static BufferData bufferData;
+static CreateShader createShader;
+static ShaderSource shaderSource;
+static CompileShader compileShader;
+static GetShaderiv getShaderiv;
+static CreateProgram createProgram;
+static AttachShader attachShader;
+static BindAttribLocation bindAttribLocation;
+static LinkProgram linkProgram;
+static GetProgramiv getProgramiv;
+static UseProgram useProgram;
+static GetUniformLocation getUniformLocation;
+static Uniform1f uniform1f;
+static EnableVertexAttribArray enableVertexAttribArray;
+static DisableVertexAttribArray disableVertexAttribArray;
+static VertexAttribPointer vertexAttribPointer;
+static VertexAttribDivisor vertexAttribDivisor;
+static DrawElementsInstanced drawElementsInstanced;
+static MultiDrawArrays multiDrawArrays;
+}
+
+template <typename Fn>
+static bool loadProc(Renderer::ProcLoader load, Fn& fn, const char* name, const char* fallback = nullptr) {
+    fn = reinterpret_cast<Fn>(load(name));
+    if (!fn && fallback)
+        fn = reinterpret_cast<Fn>(load(fallback));
+    return fn != nullptr;
+}
+
+// ------------------ Shaders -------------------
+// Instance attributes place and scale the unit sphere; lighting reproduces
+// the fixed-function setup (light 0, colour material, default model ambient)
+static const char* vertexShader =
+    "#version 120\n"
+    "attribute vec3 vertex;\n"
+    "attribute vec4 instance;\n"   // centre and radius
+    "attribute vec3 color;\n"
+    "varying vec3 shade;\n"
+    "void main() {\n"
+    "    vec4 eye = gl_ModelViewMatrix * vec4(instance.xyz + vertex * instance.w, 1.0);\n"
+    "    vec3 n = normalize(gl_NormalMatrix * vertex);\n"
+    "    vec3 l = normalize(gl_LightSource[0].position.xyz - eye.xyz);\n"
+    "    vec3 lit = gl_LightModel.ambient.rgb + gl_LightSource[0].diffuse.rgb * max(dot(n, l), 0.0);\n"
+    "    shade = min(color * lit, 1.0);\n"
+    "    gl_Position = gl_ProjectionMatrix * eye;\n"
+    "}\n";
+
+static const char* fragmentShader =
+    "#version 120\n"
+    "varying vec3 shade;\n"
+    "void main() { gl_FragColor = vec4(shade, 1.0); }\n";
+
+// Impostors: one point sprite per ball, sized to its projected diameter and
+// shaded as a sphere from the sprite coordinate
+static const char* impostorVertexShader =
+    "#version 120\n"
+    "attribute vec4 instance;\n"   // centre and radius
+    "attribute vec3 color;\n"
+    "uniform float focal;\n"       // pixels per unit at unit depth
+    "varying vec3 base;\n"
+    "varying vec3 light;\n"
+    "void main() {\n"
+    "    vec4 eye = gl_ModelViewMatrix * vec4(instance.xyz, 1.0);\n"
+    "    light = normalize(gl_LightSource[0].position.xyz - eye.xyz);\n"
+    "    base = color;\n"
+    "    gl_PointSize = max(2.0 * instance.w * focal / -eye.z, 1.0);\n"
+    "    gl_Position = gl_ProjectionMatrix * eye;\n"
+    "}\n";
+
+static const char* impostorFragmentShader =
+    "#version 120\n"
+    "varying vec3 base;\n"
+    "varying vec3 light;\n"
+    "void main() {\n"
+    "    vec2 d = gl_PointCoord * 2.0 - 1.0;\n"
+    "    float r2 = dot(d, d);\n"
+    "    if (r2 > 1.0) discard;\n"
+    "    vec3 n = vec3(d.x, -d.y, sqrt(1.0 - r2));\n"
+    "    vec3 lit = gl_LightModel.ambient.rgb + gl_LightSource[0].diffuse.rgb * max(dot(n, light), 0.0);\n"
+    "    gl_FragColor = vec4(min(base * lit, 1.0), 1.0);\n"
+    "}\n";
+
+// The impostor program reads its centre from attribute 0, which the
+// compatibility profile requires to be enabled for any draw
+enum { AttribVertex = 0, AttribInstance = 1, AttribColor = 2, AttribImpostor = 0 };
+
+static GLuint compile(GLenum type, const char* source) {
+    GLuint shader = gl::createShader(type);
+    gl::shaderSource(shader, 1, &source, nullptr);
+    gl::compileShader(shader);
+    GLint ok = 0;
+    gl::getShaderiv(shader, GL_COMPILE_STATUS_, &ok);
+    return ok ? shader : 0;
+}
+
+// Returns 0 if either stage fails; vertexAttrib may be null for programs without a mesh
+static GLuint link(const char* vertexSource, const char* fragmentSource, const char* vertexAttrib, GLuint instanceAttrib) {
+    GLuint vs = compile(GL_VERTEX_SHADER_, vertexSource);
+    GLuint fs = compile(GL_FRAGMENT_SHADER_, fragmentSource);
+    if (!vs || !fs)
+        return 0;
+    GLuint prog = gl::createProgram();
+    gl::attachShader(prog, vs);
+    gl::attachShader(prog, fs);
+    if (vertexAttrib)
+        gl::bindAttribLocation(prog, AttribVertex, vertexAttrib);
+    gl::bindAttribLocation(prog, instanceAttrib, "instance");
+    gl::bindAttribLocation(prog, AttribColor, "color");
+    gl::linkProgram(prog);
+    GLint linked = 0;
+    gl::getProgramiv(prog, GL_LINK_STATUS_, &linked);
+    return linked ? prog : 0;
+}
+
+// ------------------ Renderer -------------------
+bool Renderer::init(ProcLoader load) {
+    mesh.build();
+    loadProc(load, gl::multiDrawArrays, "glMultiDrawArrays", "glMultiDrawArraysEXT");
+
+    const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+    bool shaders = version && std::atoi(version) >= 2;
+    bool ok = shaders &&
+        loadProc(load, gl::genBuffers, "glGenBuffers") &&
+        loadProc(load, gl::bindBuffer, "glBindBuffer") &&
+        loadProc(load, gl::bufferData, "glBufferData") &&
+        loadProc(load, gl::createShader, "glCreateShader") &&
+        loadProc(load, gl::shaderSource, "glShaderSource") &&
+        loadProc(load, gl::compileShader, "glCompileShader") &&
+        loadProc(load, gl::getShaderiv, "glGetShaderiv") &&
+        loadProc(load, gl::createProgram, "glCreateProgram") &&
+        loadProc(load, gl::attachShader, "glAttachShader") &&
+        loadProc(load, gl::bindAttribLocation, "glBindAttribLocation") &&
+        loadProc(load, gl::linkProgram, "glLinkProgram") &&
+        loadProc(load, gl::getProgramiv, "glGetProgramiv") &&
+        loadProc(load, gl::useProgram, "glUseProgram") &&
+        loadProc(load, gl::getUniformLocation, "glGetUniformLocation") &&
+        loadProc(load, gl::uniform1f, "glUniform1f") &&
+        loadProc(load, gl::enableVertexAttribArray, "glEnableVertexAttribArray") &&
+        loadProc(load, gl::disableVertexAttribArray, "glDisableVertexAttribArray") &&
+        loadProc(load, gl::vertexAttribPointer, "glVertexAttribPointer") &&
+        loadProc(load, gl::vertexAttribDivisor, "glVertexAttribDivisor", "glVertexAttribDivisorARB") &&
+        loadProc(load, gl::drawElementsInstanced, "glDrawElementsInstanced", "glDrawElementsInstancedARB");
+    if (!ok)
+        return false;
+
+    program = link(vertexShader, fragmentShader, "vertex", AttribInstance);
+    if (!program)
+        return false;
+    // Without impostors the smallest balls keep the coarsest mesh
+    impostorProgram = link(impostorVertexShader, impostorFragmentShader, nullptr, AttribImpostor);
+    if (impostorProgram)
+        focalUniform = gl::getUniformLocation(impostorProgram, "focal");
+
+    GLuint buffers[3];
+    gl::genBuffers(3, buffers);
+    meshBuffer = buffers[0];
+    indexBuffer = buffers[1];
+    instanceBuffer = buffers[2];
+    gl::bindBuffer(GL_ARRAY_BUFFER_, meshBuffer);
+    gl::bufferData(GL_ARRAY_BUFFER_, mesh.vertices.size() * sizeof(float), mesh.vertices.data(), GL_STATIC_DRAW_);
+    gl::bindBuffer(GL_ELEMENT_ARRAY_BUFFER_, indexBuffer);
+    gl::bufferData(GL_ELEMENT_ARRAY_BUFFER_, mesh.indices.size() * sizeof(unsigned short), mesh.indices.data(), GL_STATIC_DRAW_);
+    gl::bindBuffer(GL_ARRAY_BUFFER_, 0);
+    gl::bindBuffer(GL_ELEMENT_ARRAY_BUFFER_, 0);
+    return true;
+}
+
+void Renderer::beginFrame(const Camera& view, const FrameSnapshot& frame, float alpha) {
+    camera = view;
+    blend = alpha;
+    stats.drawCalls = 0;
+    stats.triangles = 0;
+    stats.impostors = 0;
+    stats.culledSparks = 0;
+    for (size_t& count : stats.lodBalls)
+        count = 0;
+
+    float projection[16], modelview[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    frustum.extract(projection, modelview);
+    cullBalls(frame);
+}
+
+// Walks the snapshot's cull cells: cells wholly outside the frustum are skipped
+// without touching their balls and cells wholly inside are taken without
+// per-ball tests, so only balls near the frustum edges are tested one by one
+void Renderer::cullBalls(const FrameSnapshot& frame) {
+    const int grid = FrameSnapshot::cullGrid;
+    size_t n = frame.ballCount();
+    visible.clear();
+    if (frame.cellStart.size() != static_cast<size_t>(grid * grid * grid + 1)) {
+        for (size_t i = 0; i < n; ++i) {
+            Vec3 p = frame.position(i, blend);
+            if (frustum.sphereVisible(p.x, p.y, p.z, frame.radius[i]))
+                visible.push_back(static_cast<int>(i));
+        }
+    }
+    else {
+        const float unbounded = 1e30f;
+        float cellSize = 2.0f * frame.boxSize / grid;
+        // Cells sort by the last positions; blended ones lag by at most maxMove
+        float pad = frame.maxRadius + frame.maxMove;
+        for (int c = 0; c < grid * grid * grid; ++c) {
+            int begin = frame.cellStart[c], end = frame.cellStart[c + 1];
+            if (begin == end)
+                continue;
+            // Edge cells also hold balls past the walls, so they extend to infinity
+            int coord[3] = { c % grid, (c / grid) % grid, c / (grid * grid) };
+            float lo[3], hi[3];
+            for (int a = 0; a < 3; ++a) {
+                lo[a] = coord[a] == 0 ? -unbounded : -frame.boxSize + coord[a] * cellSize - pad;
+                hi[a] = coord[a] == grid - 1 ? unbounded : -frame.boxSize + (coord[a] + 1) * cellSize + pad;
+            }
+            Frustum::Side side = frustum.classifyBox(lo, hi);
+            if (side == Frustum::Outside)
+                continue;
+            for (int i = begin; i < end; ++i) {
+                if (side == Frustum::Inside) {
+                    visible.push_back(i);
+                    continue;
+                }
+                Vec3 p = frame.position(i, blend);
+                if (frustum.sphereVisible(p.x, p.y, p.z, frame.radius[i]))
+                    visible.push_back(i);
+            }
+        }
+    }
+    stats.visibleBalls = visible.size();
+    stats.culledBalls = n - visible.size();
+}
+
+void Renderer::endFrame(float frameMs) {
+    stats.frameMs = frameMs;
+    stats.avgFrameMs = stats.frames == 0 ? frameMs : stats.avgFrameMs * 0.95f + frameMs * 0.05f;
+    ++stats.frames;
+}
+
+int Renderer::ballLevel(const FrameSnapshot& frame, size_t i) const {
+    Vec3 p = frame.position(i, blend);
+    float pixels = camera.projectedRadius(p.x, p.y, p.z, frame.radius[i]);
+    if (impostorProgram && pixels < impostorPixels)
+        return impostorLevel;
+    return mesh.levelFor(pixels);
+}
+
+void Renderer::countSphere(int level, size_t count) {
+    stats.lodBalls[level] += count;
+    stats.triangles += count * mesh.levels[level].triangles();
+}
+
+void Renderer::drawBalls(const FrameSnapshot& frame) {
+    size_t n = visible.size();
+    if (n == 0)
+        return;
+    if (!instanced()) {
+        drawBallsFallback(frame);
+        return;
+    }
+
+    // Counting sort by level so each level is one contiguous run of instances;
+    // impostors come last
+    const int buckets = impostorLevel + 1;
+    size_t levelStart[buckets + 1] = {};
+    levelOf.resize(n);
+    for (size_t k = 0; k < n; ++k) {
+        levelOf[k] = static_cast<unsigned char>(ballLevel(frame, visible[k]));
+        ++levelStart[levelOf[k] + 1];
+    }
+    for (int l = 0; l < buckets; ++l)
+        levelStart[l + 1] += levelStart[l];
+    size_t cursor[buckets];
+    for (int l = 0; l < buckets; ++l)
+        cursor[l] = levelStart[l];
+
+    instanceData.resize(n * 7);
+    for (size_t k = 0; k < n; ++k) {
+        int i = visible[k];
+        float* d = &instanceData[cursor[levelOf[k]]++ * 7];
+        Vec3 p = frame.position(i, blend);
+        d[0] = p.x;
+        d[1] = p.y;
+        d[2] = p.z;
+        d[3] = frame.radius[i];
+        d[4] = frame.color[i].r;
+        d[5] = frame.color[i].g;
+        d[6] = frame.color[i].b;
+    }
+
+    gl::useProgram(program);
+    gl::bindBuffer(GL_ARRAY_BUFFER_, meshBuffer);
+    gl::enableVertexAttribArray(AttribVertex);
+    gl::vertexAttribPointer(AttribVertex, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+    // Orphan and refill the instance buffer every frame
+    const GLsizei stride = 7 * sizeof(float);
+    gl::bindBuffer(GL_ARRAY_BUFFER_, instanceBuffer);
+    gl::bufferData(GL_ARRAY_BUFFER_, instanceData.size() * sizeof(float), instanceData.data(), GL_STREAM_DRAW_);
+    gl::enableVertexAttribArray(AttribInstance);
+    gl::vertexAttribDivisor(AttribInstance, 1);
+    gl::enableVertexAttribArray(AttribColor);
+    gl::vertexAttribDivisor(AttribColor, 1);
+    gl::bindBuffer(GL_ELEMENT_ARRAY_BUFFER_, indexBuffer);
+
+    // One instanced draw per level in use; the instance pointers start at the level's run
+    for (int l = 0; l < MeshCache::levelCount; ++l) {
+        size_t count = levelStart[l + 1] - levelStart[l];
+        if (count == 0)
+            continue;
+        const MeshLevel& level = mesh.levels[l];
+        const char* base = reinterpret_cast<const char*>(levelStart[l] * stride);
+        gl::vertexAttribPointer(AttribInstance, 4, GL_FLOAT, GL_FALSE, stride, base);
+        gl::vertexAttribPointer(AttribColor, 3, GL_FLOAT, GL_FALSE, stride, base + 4 * sizeof(float));
+        gl::drawElementsInstanced(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_SHORT,
+            reinterpret_cast<const void*>(level.firstIndex * sizeof(unsigned short)), static_cast<GLsizei>(count));
+        ++stats.drawCalls;
+        countSphere(l, count);
+    }
+
+    gl::vertexAttribDivisor(AttribInstance, 0);
+    gl::vertexAttribDivisor(AttribColor, 0);
+    gl::disableVertexAttribArray(AttribVertex);
+    gl::disableVertexAttribArray(AttribInstance);
+    gl::bindBuffer(GL_ELEMENT_ARRAY_BUFFER_, 0);
+
+    // Impostors: one point per ball from the tail of the same instance buffer
+    size_t impostors = levelStart[buckets] - levelStart[impostorLevel];
+    if (impostors > 0) {
+        const char* base = reinterpret_cast<const char*>(levelStart[impostorLevel] * stride);
+        gl::useProgram(impostorProgram);
+        gl::uniform1f(focalUniform, camera.focalPixels());
+        glEnable(GL_VERTEX_PROGRAM_POINT_SIZE_);
+        glEnable(GL_POINT_SPRITE_);
+        gl::enableVertexAttribArray(AttribImpostor);
+        gl::vertexAttribPointer(AttribImpostor, 4, GL_FLOAT, GL_FALSE, stride, base);
+        gl::vertexAttribPointer(AttribColor, 3, GL_FLOAT, GL_FALSE, stride, base + 4 * sizeof(float));
+        glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(impostors));
+        ++stats.drawCalls;
+        stats.impostors += impostors;
+        gl::disableVertexAttribArray(AttribImpostor);
+        glDisable(GL_POINT_SPRITE_);
+        glDisable(GL_VERTEX_PROGRAM_POINT_SIZE_);
+    }
+
+    // Leave the fixed-function state as the rest of the frame expects it
+    gl::disableVertexAttribArray(AttribColor);
+    gl::bindBuffer(GL_ARRAY_BUFFER_, 0);
+    gl::useProgram(0);
+}
+
+// No instancing: the cached mesh is still drawn from client arrays, one call per ball
+void Renderer::drawBallsFallback(const FrameSnapshot& frame) {
+    glEnable(GL_NORMALIZE);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, mesh.vertices.data());
+    glNormalPointer(GL_FLOAT, 0, mesh.vertices.data());
+    for (int i : visible) {
+        int l = ballLevel(frame, i);
+        const MeshLevel& level = mesh.levels[l];
+        Vec3 p = frame.position(i, blend);
+        glPushMatrix();
+        glTranslatef(p.x, p.y, p.z);
+        glScalef(frame.radius[i], frame.radius[i], frame.radius[i]);
+        glColor3f(frame.color[i].r, frame.color[i].g, frame.color[i].b);
+        glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_SHORT, &mesh.indices[level.firstIndex]);
+        ++stats.drawCalls;
+        countSphere(l, 1);
+        glPopMatrix();
+    }
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisable(GL_NORMALIZE);
+}
+
+// Decoration spheres use the same level selection as the balls
+void Renderer::drawSphere(float radius, float x, float y, float z) {
+    int l = mesh.levelFor(camera.projectedRadius(x, y, z, radius));
+    const MeshLevel& level = mesh.levels[l];
+    glEnable(GL_NORMALIZE);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, mesh.vertices.data());
+    glNormalPointer(GL_FLOAT, 0, mesh.vertices.data());
+    glPushMatrix();
+    glTranslatef(x, y, z);
+    glScalef(radius, radius, radius);
+    glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_SHORT, &mesh.indices[level.firstIndex]);
+    glPopMatrix();
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisable(GL_NORMALIZE);
+    stats.triangles += level.triangles();
+}
+
+void Renderer::drawRing(float radius, float y) {
+    glPushMatrix();
+    glTranslatef(0.0f, y, 0.0f);
+    glScalef(radius, 1.0f, radius);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, mesh.ring.data());
+    glDrawArrays(GL_LINE_LOOP, 0, MeshCache::ringSegments);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glPopMatrix();
+}
+
+void Renderer::drawSparks(const FrameSnapshot& frame) {
+    size_t n = frame.sparkCount();
+    if (n == 0)
+        return;
+    pointData.resize(n * 3);
+    colorData.resize(n * 4);
+    size_t shown = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!frustum.pointVisible(frame.sparkX[i], frame.sparkY[i], frame.sparkZ[i]))
+            continue;
+        pointData[shown * 3 + 0] = frame.sparkX[i];
+        pointData[shown * 3 + 1] = frame.sparkY[i];
+        pointData[shown * 3 + 2] = frame.sparkZ[i];
+        colorData[shown * 4 + 0] = 1.0f;
+        colorData[shown * 4 + 1] = frame.sparkG[i];
+        colorData[shown * 4 + 2] = 0.0f;
+        colorData[shown * 4 + 3] = frame.sparkLife[i];
+        ++shown;
+    }
+    stats.culledSparks = n - shown;
+    if (shown == 0)
+        return;
+
+    glPointSize(3.0f);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, pointData.data());
+    glColorPointer(4, GL_FLOAT, 0, colorData.data());
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(shown));
+    ++stats.drawCalls;
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+// Only trails of balls that survived culling are drawn
+void Renderer::drawTrails(const FrameSnapshot& frame) {
+    if (frame.trailPoints.empty())
+        return;
+    pointData.resize(frame.trailPoints.size() * 3);
+    colorData.resize(frame.trailPoints.size() * 4);
+    trailFirst.clear();
+    trailCount.clear();
+    int packed = 0;
+    for (int slot : visible) {
+        int first = frame.trailStart[slot];
+        int count = frame.trailStart[slot + 1] - first;
+        if (count < 2)
+            continue;
+        for (int i = 0; i < count; ++i) {
+            const Vec3& p = frame.trailPoints[first + i];
+            float alpha = float(i) / count;
+            float* v = &pointData[(packed + i) * 3];
+            float* c = &colorData[(packed + i) * 4];
+            v[0] = p.x; v[1] = p.y; v[2] = p.z;
+            c[0] = 1.0f; c[1] = 1.0f - alpha; c[2] = 1.0f; c[3] = alpha;
+        }
+        trailFirst.push_back(packed);
+        trailCount.push_back(count);
+        packed += count;
+    }
+    if (trailFirst.empty())
+        return;
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, pointData.data());
+    glColorPointer(4, GL_FLOAT, 0, colorData.data());
+    if (gl::multiDrawArrays) {
+        gl::multiDrawArrays(GL_LINE_STRIP, trailFirst.data(), trailCount.data(), static_cast<GLsizei>(trailFirst.size()));
+        ++stats.drawCalls;
+    }
+    else {
+        for (size_t k = 0; k < trailFirst.size(); ++k) {
+            glDrawArrays(GL_LINE_STRIP, trailFirst[k], trailCount[k]);
+            ++stats.drawCalls;
+        }
+    }
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
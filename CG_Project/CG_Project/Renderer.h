@@ -0,0 +1,83 @@
+﻿#pragma once
+
+#include <vector>
+
+#include "Frustum.h"
+#include "MeshCache.h"
+#include "SimThread.h"
+
+// ------------------ Batched Renderer -------------------
+// Draws a frame snapshot with a fixed number of draw calls: every ball is one
+// instance of a cached sphere mesh, all sparks are one point buffer and all
+// trails are one multi-draw line buffer. Instancing needs GL 3.3 or
+// ARB_instanced_arrays (Mesa llvmpipe has both); without it balls fall back
+// to one indexed draw of the cached mesh per ball. The GL entry points above
+// 1.1 are loaded at init, so no extension loader is needed. Each ball picks a
+// sphere level of detail from its projected size, so distant balls cost a
+// few dozen triangles instead of a few hundred, and balls only a couple of
+// pixels across become point-sprite impostors. Balls, trails and sparks
+// outside the view frustum are culled before anything is uploaded.
+struct RenderStats {
+    int drawCalls = 0;            // draw calls issued for balls, sparks and trails this frame
+    size_t triangles = 0;         // sphere triangles submitted this frame
+    size_t lodBalls[MeshCache::levelCount] = {};  // balls drawn at each level this frame
+    size_t impostors = 0;         // balls drawn as point sprites this frame
+    size_t visibleBalls = 0, culledBalls = 0, culledSparks = 0;
+    float frameMs = 0;            // CPU time of the last frame, including the buffer swap
+    float avgFrameMs = 0;         // exponential moving average of frameMs
+    size_t frames = 0;
+};
+
+class Renderer {
+public:
+    using ProcLoader = void* (*)(const char* name);
+
+    // Call once with a current GL context; returns false if instancing is unavailable
+    bool init(ProcLoader load);
+    bool instanced() const { return program != 0; }
+
+    // Call once the camera transform is current: culls the frame's balls against
+    // the frustum of the current projection and modelview. Balls are drawn
+    // blend of the way from their previous to their last physics position.
+    void beginFrame(const Camera& view, const FrameSnapshot& frame, float blend);
+    void endFrame(float frameMs);
+
+    void drawBalls(const FrameSnapshot& frame);
+    void drawSparks(const FrameSnapshot& frame);
+    void drawTrails(const FrameSnapshot& frame);
+
+    // Cached meshes for scene decoration, drawn with the current colour and transform
+    void drawSphere(float radius, float x, float y, float z);
+    void drawRing(float radius, float y);
+
+    const MeshCache& meshes() const { return mesh; }
+    RenderStats stats;
+
+private:
+    void drawBallsFallback(const FrameSnapshot& frame);
+
+    // Radius in pixels below which a ball is drawn as an impostor
+    static constexpr float impostorPixels = 2.5f;
+    static constexpr int impostorLevel = MeshCache::levelCount;
+
+    void cullBalls(const FrameSnapshot& frame);
+    int ballLevel(const FrameSnapshot& frame, size_t i) const;
+    void countSphere(int level, size_t count);
+
+    MeshCache mesh;
+    Camera camera;
+    Frustum frustum;
+    float blend = 1.0f;
+
+    // Per-frame staging, reused so steady state allocates nothing
+    std::vector<float> instanceData;    // x, y, z, radius, r, g, b per ball, grouped by level
+    std::vector<int> visible;           // snapshot slots that survived culling
+    std::vector<unsigned char> levelOf; // level chosen for each visible ball
+    std::vector<float> pointData;       // x, y, z per spark or trail point
+    std::vector<float> colorData;       // r, g, b, a per spark or trail point
+    std::vector<int> trailFirst, trailCount;
+
+    unsigned program = 0, impostorProgram = 0;
+    int focalUniform = -1;
+    unsigned meshBuffer = 0, indexBuffer = 0, instanceBuffer = 0;
+};
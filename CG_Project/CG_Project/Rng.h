@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// ------------------ Random Numbers -------------------
+// Counter-based generator: every value is a pure function of
+// (seed, stream, counter), built from the SplitMix64 finaliser. There is no
+// shared mutable state, so any thread can draw from any stream, batches can
+// be filled out of order, and a given seed always gives the same numbers.
+enum RngPurpose : uint32_t {
+    RngSpawn = 1,     // ball colours and positions chosen at spawn time
+    RngSparks = 2,    // spark directions and colours
+    RngJitter = 3     // entropy jitter, one stream per step
+};
+
+struct Rng {
+    uint64_t seed = 1;
+
+    Rng() {}
+    explicit Rng(uint64_t seed) : seed(seed) {}
+
+    static uint64_t mix(uint64_t z) {
+        z += 0x9e3779b97f4a7c15ull;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // Stream id for a purpose and an index within it (e.g. the step number)
+    static uint64_t stream(RngPurpose purpose, uint64_t index = 0) { return (uint64_t(purpose) << 48) ^ index; }
+
+    uint64_t key(uint64_t stream) const { return mix(seed ^ mix(stream)); }
+
+    uint64_t bits(uint64_t stream, uint64_t counter) const { return mix(key(stream) + counter); }
+
+    static float toUnit(uint64_t b) { return (b >> 40) * (1.0f / 16777216.0f); }
+
+    // Uniform in [0, 1)
+    float uniform(uint64_t stream, uint64_t counter) const { return toUnit(bits(stream, counter)); }
+
+    // Uniform in [-1, 1) from a stream key (see key()) and a counter
+    static float symmetric(uint64_t key, uint64_t counter) { return toUnit(mix(key + counter)) * 2.0f - 1.0f; }
+};
+
+// Sequential view of one stream, for code that draws numbers one after another
+struct RngStream {
+    uint64_t k = 0;
+    uint64_t counter = 0;
+
+    RngStream() {}
+    RngStream(const Rng& rng, uint64_t stream) : k(rng.key(stream)) {}
+
+    uint64_t next() { return Rng::mix(k + counter++); }
+
+    float uniform() { return Rng::toUnit(next()); }                     // [0, 1)
+    float range(float lo, float hi) { return lo + (hi - lo) * uniform(); }
+    int below(int n) { return static_cast<int>((next() >> 33) % uint64_t(n)); }   // [0, n)
+};
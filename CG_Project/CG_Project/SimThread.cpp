@@ -0,0 +1,301 @@
+﻿#include "SimThread.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "Recording.h"
+
+// ------------------ Commands -------------------
+void spawnRandomBall(World& world, float minHeight, int heightRange, float minRadius) {
+    RngStream& rng = world.spawnRng;
+    float x = rng.below(10) - 5.0f;
+    float y = minHeight + rng.below(heightRange);
+    float z = rng.below(10) - 5.0f;
+    float vx = (rng.below(100) - 50) / 50.0f;
+    float vz = (rng.below(100) - 50) / 50.0f;
+    float radius = minRadius + rng.below(10) / 20.0f;
+    world.balls.add(Ball(Vec3(x, y, z), Vec3(vx, 0, vz), radius, rng));
+}
+
+SpawnReport spawnStartingBalls(World& world, size_t count) {
+    SpawnParams params;
+    params.count = count;
+    params.lo = Vec3(-world.boxSize, 0, -world.boxSize);
+    if (spawnCapacity(world, params) < count)
+        params.lo = Vec3(-world.boxSize, -world.boxSize, -world.boxSize);
+    SpawnReport report = spawnBalls(world, params);
+    // Reset repeats this exact layout, so it keeps the key instead of drawing a new one
+    world.startSpawn = params;
+    world.startSpawn.fixedKey = true;
+    world.startSpawn.key = report.key;
+    return report;
+}
+
+void applyCommand(World& world, const Command& cmd) {
+    switch (cmd.type) {
+    case CmdTogglePause:
+        world.paused = !world.paused;
+        break;
+    case CmdReset:
+        clearBalls(world);
+        spawnBalls(world, world.startSpawn);
+        break;
+    case CmdClear:
+        clearBalls(world);
+        break;
+    case CmdSpawnBall:
+        spawnRandomBall(world, 10.0f, 5, 0.5f);
+        break;
+    case CmdTimeScale:
+        world.timeScale = std::min(5.0f, std::max(0.1f, world.timeScale + cmd.value));
+        break;
+    case CmdGravity:
+        world.globalGravity += cmd.value;
+        break;
+    case CmdFriction:
+        world.globalFriction = std::max(0.0f, world.globalFriction + cmd.value);
+        break;
+    case CmdEntropy:
+        world.entropyLevel = std::max(0.0f, world.entropyLevel + cmd.value);
+        break;
+    case CmdRestitution:
+        world.restitution = std::min(1.0f, std::max(0.0f, world.restitution + cmd.value));
+        break;
+    case CmdToggleMagnetic:
+        world.wallsAreMagnetic = !world.wallsAreMagnetic;
+        break;
+    case CmdToggleBlackHole:
+        world.blackHoleMode = !world.blackHoleMode;
+        break;
+    case CmdToggleCursorGravity:
+        world.cursorGravityMode = !world.cursorGravityMode;
+        break;
+    case CmdToggleBroadPhase:
+        world.useSpatialHash = !world.useSpatialHash;
+        break;
+    case CmdToggleNbody:
+        world.nbodyMode = !world.nbodyMode;
+        break;
+    case CmdToggleSleep:
+        world.sleepEnabled = !world.sleepEnabled;
+        break;
+    case CmdToggleCcd:
+        world.ccdEnabled = !world.ccdEnabled;
+        break;
+    case CmdCursorTarget:
+        world.cursorWorldTarget = cmd.target;
+        break;
+    }
+}
+
+// ------------------ Frame Snapshot -------------------
+// Counting sort by cull cell: fills cellStart and ballOrder[slot], the source
+// index drawn at slot. position(i) gives the position of source ball i.
+template <typename Position>
+static void sortIntoCells(FrameSnapshot& out, size_t n, float boxSize, Position position) {
+    const int grid = FrameSnapshot::cullGrid;
+    float cellSize = 2.0f * boxSize / grid;
+    auto coord = [&](float v) {
+        int c = static_cast<int>((v + boxSize) / cellSize);
+        return c < 0 ? 0 : c >= grid ? grid - 1 : c;
+    };
+    out.ballCell.resize(n);
+    out.ballOrder.resize(n);
+    out.cellStart.assign(grid * grid * grid + 1, 0);
+    for (size_t i = 0; i < n; ++i) {
+        Vec3 p = position(i);
+        int cell = (coord(p.z) * grid + coord(p.y)) * grid + coord(p.x);
+        out.ballCell[i] = cell;
+        ++out.cellStart[cell + 1];
+    }
+    for (int c = 0; c < grid * grid * grid; ++c)
+        out.cellStart[c + 1] += out.cellStart[c];
+    for (size_t i = 0; i < n; ++i)
+        out.ballOrder[out.cellStart[out.ballCell[i]]++] = static_cast<int>(i);
+    for (int c = grid * grid * grid; c > 0; --c)
+        out.cellStart[c] = out.cellStart[c - 1];
+    out.cellStart[0] = 0;
+}
+
+double snapshotClock() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void captureSnapshot(const World& world, const FixedStepper& stepper, FrameSnapshot& out) {
+    const BallSystem& balls = world.balls;
+    size_t n = balls.size();
+
+    // assign/resize keep their capacity, so steady state allocates nothing
+    sortIntoCells(out, n, world.boxSize, [&](size_t i) { return balls.position(i); });
+
+    // While paused the last state is simply held
+    bool previous = !world.paused && stepper.hasPrevious(world);
+    size_t m = previous ? n : 0;
+    out.px.resize(n);
+    out.py.resize(n);
+    out.pz.resize(n);
+    out.prevX.resize(m);
+    out.prevY.resize(m);
+    out.prevZ.resize(m);
+    out.radius.resize(n);
+    out.color.resize(n);
+    out.maxRadius = 0;
+    out.maxMove = 0;
+    for (size_t slot = 0; slot < n; ++slot) {
+        int i = out.ballOrder[slot];
+        out.px[slot] = balls.px[i];
+        out.py[slot] = balls.py[i];
+        out.pz[slot] = balls.pz[i];
+        out.radius[slot] = balls.radius[i];
+        out.color[slot] = balls.color[i];
+        out.maxRadius = std::max(out.maxRadius, balls.radius[i]);
+        if (previous) {
+            out.prevX[slot] = stepper.prevX[i];
+            out.prevY[slot] = stepper.prevY[i];
+            out.prevZ[slot] = stepper.prevZ[i];
+            Vec3 move(balls.px[i] - stepper.prevX[i], balls.py[i] - stepper.prevY[i], balls.pz[i] - stepper.prevZ[i]);
+            out.maxMove = std::max(out.maxMove, move.length());
+        }
+    }
+
+    const TrailStore& trails = balls.trails;
+    out.trailStart.resize(n + 1);
+    out.trailPoints.clear();
+    for (size_t slot = 0; slot < n; ++slot) {
+        int i = out.ballOrder[slot];
+        out.trailStart[slot] = static_cast<int>(out.trailPoints.size());
+        for (int k = 0; k < trails.count[i]; ++k)
+            out.trailPoints.push_back(trails.point(i, k));
+    }
+    out.trailStart[n] = static_cast<int>(out.trailPoints.size());
+
+    const SparkPool& sparks = world.sparks;
+    size_t live = sparks.size();
+    out.sparkX.assign(sparks.px.begin(), sparks.px.begin() + live);
+    out.sparkY.assign(sparks.py.begin(), sparks.py.begin() + live);
+    out.sparkZ.assign(sparks.pz.begin(), sparks.pz.begin() + live);
+    out.sparkG.assign(sparks.g.begin(), sparks.g.begin() + live);
+    out.sparkLife.assign(sparks.life.begin(), sparks.life.begin() + live);
+
+    out.boxSize = world.boxSize;
+    out.gravity = world.globalGravity;
+    out.friction = world.globalFriction;
+    out.restitution = world.restitution;
+    out.entropy = world.entropyLevel;
+    out.timeScale = world.timeScale;
+    out.paused = world.paused;
+    out.magnetic = world.wallsAreMagnetic;
+    out.blackHole = world.blackHoleMode;
+    out.cursorGravity = world.cursorGravityMode;
+    out.nbody = world.nbodyMode;
+    out.sleep = world.sleepEnabled;
+    out.spatialHash = world.useSpatialHash;
+    out.ccd = world.ccdEnabled;
+    out.sleepingBalls = world.sleepingBalls;
+    out.pairsTested = world.pairsTested;
+    out.ccdSweeps = world.ccdSweeps;
+    out.contacts = world.contacts.size();
+    out.solverIterations = world.solverIterations;
+    out.solverIterationsUsed = world.solverIterationsUsed;
+    out.cacheHitRate = world.cacheHitRate;
+    out.residualPenetration = world.residualPenetration;
+    out.sparkCapacity = sparks.capacity();
+    out.sparksDropped = sparks.droppedLastStep;
+    out.physicsRate = stepper.physicsRate;
+    out.stepsLastFrame = stepper.stepsLastFrame;
+
+    // The last step's state was due when the accumulator was last empty
+    float scale = std::max(0.1f, world.timeScale);
+    out.stepSeconds = stepper.stepSize() / scale;
+    out.stepTime = snapshotClock() - stepper.accumulator / scale;
+}
+
+void replaySnapshot(const RecordingHeader& header, const RecordedFrame& frame, FrameSnapshot& out) {
+    size_t n = frame.ballCount();
+    sortIntoCells(out, n, header.boxSize, [&](size_t i) { return Vec3(frame.px[i], frame.py[i], frame.pz[i]); });
+
+    out.px.resize(n);
+    out.py.resize(n);
+    out.pz.resize(n);
+    out.prevX.clear();
+    out.prevY.clear();
+    out.prevZ.clear();
+    out.radius.resize(n);
+    out.color.resize(n);
+    out.maxRadius = 0;
+    out.maxMove = 0;
+    for (size_t slot = 0; slot < n; ++slot) {
+        int i = out.ballOrder[slot];
+        out.px[slot] = frame.px[i];
+        out.py[slot] = frame.py[i];
+        out.pz[slot] = frame.pz[i];
+        out.radius[slot] = frame.radius[i];
+        out.color[slot] = frame.color[i];
+        out.maxRadius = std::max(out.maxRadius, frame.radius[i]);
+    }
+
+    // Recordings hold balls only
+    out.trailStart.assign(n + 1, 0);
+    out.trailPoints.clear();
+    out.sparkX.clear();
+    out.sparkY.clear();
+    out.sparkZ.clear();
+    out.sparkG.clear();
+    out.sparkLife.clear();
+
+    out.boxSize = header.boxSize;
+    out.gravity = header.globalGravity;
+    out.friction = header.globalFriction;
+    out.restitution = header.restitution;
+    out.entropy = header.entropyLevel;
+    out.timeScale = header.timeScale;
+    out.physicsRate = header.stepSize > 0 ? 1.0f / header.stepSize : 0.0f;
+}
+
+// ------------------ Simulation Thread -------------------
+void SimThread::start(World& w, FixedStepper& s) {
+    stop();
+    world = &w;
+    stepper = &s;
+    captureSnapshot(*world, *stepper, snapshots.back());
+    snapshots.publish();
+    running = true;
+    thread = std::thread(&SimThread::run, this);
+}
+
+void SimThread::stop() {
+    running = false;
+    if (thread.joinable())
+        thread.join();
+}
+
+void SimThread::run() {
+    using clock = std::chrono::steady_clock;
+    auto last = clock::now();
+
+    while (running) {
+        auto begin = clock::now();
+        float frameSeconds = std::chrono::duration<float>(begin - last).count();
+        last = begin;
+
+        Command cmd;
+        while (commands.pop(cmd))
+            applyCommand(*world, cmd);
+
+        advanceFixed(*world, *stepper, frameSeconds);
+        if (recorder && stepper->stepsLastFrame > 0)
+            recorder->capture(*world);
+
+        FrameSnapshot& out = snapshots.back();
+        captureSnapshot(*world, *stepper, out);
+        out.simMs = std::chrono::duration<float, std::milli>(clock::now() - begin).count();
+        snapshots.publish();
+
+        // Sleep until the next physics step is due
+        float h = stepper->stepSize();
+        float wait = world->paused ? h : (h - stepper->accumulator) / std::max(0.1f, world->timeScale);
+        float spent = std::chrono::duration<float>(clock::now() - begin).count();
+        if (wait > spent)
+            std::this_thread::sleep_for(std::chrono::duration<float>(wait - spent));
+    }
+}
@@ -0,0 +1,171 @@
+﻿#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "FixedStep.h"
+#include "Spawn.h"
+#include "SpscQueue.h"
+#include "TripleBuffer.h"
+#include "World.h"
+
+class RecordingWriter;
+struct RecordingHeader;
+struct RecordedFrame;
+
+// ------------------ Commands -------------------
+// Input forwarded from the front end to the simulation thread
+enum CommandType {
+    CmdTogglePause,
+    CmdReset,             // clear and respawn the starting balls
+    CmdClear,
+    CmdSpawnBall,
+    CmdTimeScale,         // value: delta
+    CmdGravity,           // value: delta
+    CmdFriction,          // value: delta
+    CmdEntropy,           // value: delta
+    CmdRestitution,       // value: delta
+    CmdToggleMagnetic,
+    CmdToggleBlackHole,
+    CmdToggleCursorGravity,
+    CmdToggleBroadPhase,
+    CmdToggleNbody,
+    CmdToggleSleep,
+    CmdToggleCcd,
+    CmdCursorTarget,      // target: new cursor position
+};
+
+struct Command {
+    CommandType type;
+    float value = 0;
+    Vec3 target;
+};
+
+// Applies one command to the world; runs on the simulation thread
+void applyCommand(World& world, const Command& cmd);
+
+// Drops a ball at a random spot above the floor with a random sideways velocity
+void spawnRandomBall(World& world, float minHeight, int heightRange, float minRadius);
+
+// Starting layout: balls spread without overlap through the upper half of the
+// box, or through the whole box when they do not fit there. The layout is
+// kept, with its jitter key, in world.startSpawn so CmdReset repeats it exactly.
+SpawnReport spawnStartingBalls(World& world, size_t count);
+
+// ------------------ Frame Snapshot -------------------
+// Everything the renderer draws for one frame, copied out of the World so the
+// simulation can keep stepping while the frame is drawn. Balls carry the last
+// two physics states; the render thread blends between them by its own clock
+// (blendAlpha), so a display faster than the physics rate still sees motion
+// on every frame.
+struct FrameSnapshot {
+    // Balls at the last physics step, and where they were one step earlier.
+    // prevX/Y/Z are empty when balls were added or removed since then.
+    std::vector<float> px, py, pz, radius;
+    std::vector<float> prevX, prevY, prevZ;
+    std::vector<Color> color;
+    float maxRadius = 0;
+    float maxMove = 0;            // largest distance a ball moved in the last step
+
+    // Steady-clock time (seconds) at which the last step's state was due, and
+    // the wall time one step spans at the current time scale
+    double stepTime = 0;
+    float stepSeconds = 0;
+
+    // Balls are stored grouped by a coarse cullGrid^3 grid over the box: cell c
+    // holds balls [cellStart[c], cellStart[c + 1]), so the renderer can cull
+    // whole cells against the view frustum. Edge cells also hold anything past the walls.
+    static constexpr int cullGrid = 8;
+    std::vector<int> cellStart;
+    std::vector<int> ballCell, ballOrder;   // scratch for the cell sort
+
+    // Trail points, oldest first; ball i owns trailPoints[trailStart[i], trailStart[i + 1])
+    std::vector<int> trailStart;
+    std::vector<Vec3> trailPoints;
+
+    // Sparks
+    std::vector<float> sparkX, sparkY, sparkZ, sparkG, sparkLife;
+
+    // Parameters and stats shown by the HUD
+    float boxSize = 0;
+    float gravity = 0, friction = 0, restitution = 0, entropy = 0, timeScale = 1;
+    bool paused = false, magnetic = false, blackHole = false, cursorGravity = false;
+    bool nbody = false, sleep = false, spatialHash = false, ccd = false;
+    size_t sleepingBalls = 0, pairsTested = 0, ccdSweeps = 0, contacts = 0;
+    int solverIterations = 0, solverIterationsUsed = 0;
+    float cacheHitRate = 0, residualPenetration = 0;
+    size_t sparkCapacity = 0, sparksDropped = 0;
+    float physicsRate = 0;
+    int stepsLastFrame = 0;
+    float simMs = 0;              // wall time of the last simulation iteration
+
+    size_t ballCount() const { return px.size(); }
+    size_t sparkCount() const { return sparkX.size(); }
+
+    // Share of the way from the previous to the last step at render time now, in [0, 1]
+    float blendAlpha(double now) const {
+        if (prevX.empty() || stepSeconds <= 0)
+            return 1.0f;
+        float a = static_cast<float>((now - stepTime) / stepSeconds);
+        return a < 0 ? 0.0f : a > 1 ? 1.0f : a;
+    }
+
+    // Position of slot i blended alpha of the way from the previous step to the last
+    Vec3 position(size_t i, float alpha) const {
+        if (prevX.empty())
+            return Vec3(px[i], py[i], pz[i]);
+        return Vec3(prevX[i] + (px[i] - prevX[i]) * alpha,
+                    prevY[i] + (py[i] - prevY[i]) * alpha,
+                    prevZ[i] + (pz[i] - prevZ[i]) * alpha);
+    }
+};
+
+// Current time on the clock FrameSnapshot::stepTime is measured against
+double snapshotClock();
+
+void captureSnapshot(const World& world, const FixedStepper& stepper, FrameSnapshot& out);
+// Snapshot of a recorded frame, for the replay viewer; no trails or sparks
+void replaySnapshot(const RecordingHeader& header, const RecordedFrame& frame, FrameSnapshot& out);
+
+// ------------------ Simulation Thread -------------------
+// Steps the world on its own thread at the fixed physics rate. Input arrives
+// through a single-producer command queue and each iteration publishes a
+// snapshot through a triple buffer, so a frame costs max(sim, render) rather
+// than sim + render. Once started, the world belongs to the simulation thread.
+class SimThread {
+public:
+    ~SimThread() { stop(); }
+
+    void start(World& world, FixedStepper& stepper);
+    void stop();
+
+    // Captures the world after every iteration that stepped; set before start()
+    void record(RecordingWriter* writer) { recorder = writer; }
+
+    // Producer side; returns false if the queue is full and the command was dropped
+    bool send(const Command& cmd) { return commands.push(cmd); }
+    bool send(CommandType type, float value = 0) {
+        Command cmd;
+        cmd.type = type;
+        cmd.value = value;
+        return send(cmd);
+    }
+
+    // Reader side: the newest published snapshot
+    const FrameSnapshot& latest() {
+        snapshots.acquire();
+        return snapshots.front();
+    }
+
+private:
+    void run();
+
+    World* world = nullptr;
+    FixedStepper* stepper = nullptr;
+    RecordingWriter* recorder = nullptr;
+    std::thread thread;
+    std::atomic<bool> running{ false };
+    SpscQueue<Command, 1024> commands;
+    TripleBuffer<FrameSnapshot> snapshots;
+};
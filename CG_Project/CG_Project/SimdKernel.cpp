@@ -0,0 +1,344 @@
+﻿#include "SimdKernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GRAVITY_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// ------------------ CPU Dispatch -------------------
+SimdLevel detectSimdLevel() {
+#if GRAVITY_X86
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (osxsave && avx && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5))
+            return SimdAVX2;
+    }
+    return SimdSSE2;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SimdAVX2;
+    return __builtin_cpu_supports("sse2") ? SimdSSE2 : SimdScalar;
+#endif
+#else
+    return SimdScalar;
+#endif
+}
+
+SimdLevel resolveSimdLevel(SimdLevel requested) {
+    static const SimdLevel best = detectSimdLevel();
+    if (requested == SimdAuto)
+        return best;
+    return std::min(requested, best);
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+    case SimdScalar: return "scalar";
+    case SimdSSE2: return "sse2";
+    case SimdAVX2: return "avx2";
+    default: return "auto";
+    }
+}
+
+// ------------------ Force Fields -------------------
+// Each optional force is a policy with one apply() overload per lane type:
+// float for the scalar kernel, __m128 for SSE2 and __m256 for AVX2. The
+// kernels below are instantiated once per combination of active fields, so a
+// disabled field is not in the loop at all. A new field is a new policy here,
+// its parameters in ForceParams, and an entry in AllFields.
+struct BlackHoleField {
+    static bool active(const ForceParams& p) { return p.blackHole; }
+
+    static void apply(const ForceParams& p, float x, float y, float z, float& ux, float& uy, float& uz) {
+        float dt = p.dt;
+        float tx = 0.0f - x, ty = 0.0f - y, tz = 0.0f - z;
+        float len = std::sqrt(tx * tx + ty * ty + tz * tz);
+        float k = 100.0f / std::max(1.0f, len);
+        if (len > 0) {
+            ux += tx / len * k * dt;
+            uy += ty / len * k * dt;
+            uz += tz / len * k * dt;
+        }
+    }
+
+#if GRAVITY_X86
+    static void apply(const ForceParams& p, __m128 x, __m128 y, __m128 z, __m128& ux, __m128& uy, __m128& uz) {
+        const __m128 dt = _mm_set1_ps(p.dt), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        __m128 tx = _mm_sub_ps(zero, x), ty = _mm_sub_ps(zero, y), tz = _mm_sub_ps(zero, z);
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz)));
+        __m128 k = _mm_div_ps(_mm_set1_ps(100.0f), _mm_max_ps(one, len));
+        __m128 mask = _mm_cmpgt_ps(len, zero);
+        ux = _mm_add_ps(ux, _mm_and_ps(mask, _mm_mul_ps(_mm_mul_ps(_mm_div_ps(tx, len), k), dt)));
+        uy = _mm_add_ps(uy, _mm_and_ps(mask, _mm_mul_ps(_mm_mul_ps(_mm_div_ps(ty, len), k), dt)));
+        uz = _mm_add_ps(uz, _mm_and_ps(mask, _mm_mul_ps(_mm_mul_ps(_mm_div_ps(tz, len), k), dt)));
+    }
+
+    TARGET_AVX2
+    static void apply(const ForceParams& p, __m256 x, __m256 y, __m256 z, __m256& ux, __m256& uy, __m256& uz) {
+        const __m256 dt = _mm256_set1_ps(p.dt), zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+        __m256 tx = _mm256_sub_ps(zero, x), ty = _mm256_sub_ps(zero, y), tz = _mm256_sub_ps(zero, z);
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz)));
+        __m256 k = _mm256_div_ps(_mm256_set1_ps(100.0f), _mm256_max_ps(one, len));
+        __m256 mask = _mm256_cmp_ps(len, zero, _CMP_GT_OQ);
+        ux = _mm256_add_ps(ux, _mm256_and_ps(mask, _mm256_mul_ps(_mm256_mul_ps(_mm256_div_ps(tx, len), k), dt)));
+        uy = _mm256_add_ps(uy, _mm256_and_ps(mask, _mm256_mul_ps(_mm256_mul_ps(_mm256_div_ps(ty, len), k), dt)));
+        uz = _mm256_add_ps(uz, _mm256_and_ps(mask, _mm256_mul_ps(_mm256_mul_ps(_mm256_div_ps(tz, len), k), dt)));
+    }
+#endif
+};
+
+struct CursorField {
+    static bool active(const ForceParams& p) { return p.cursor; }
+
+    static void apply(const ForceParams& p, float x, float y, float z, float& ux, float& uy, float& uz) {
+        float dt = p.dt;
+        float tx = p.cursorX - x, ty = p.cursorY - y, tz = p.cursorZ - z;
+        float len = std::sqrt(tx * tx + ty * ty + tz * tz);
+        if (len > 0.5f) {
+            float k = 200.0f / len;
+            ux += tx / len * k * dt;
+            uy += ty / len * k * dt;
+            uz += tz / len * k * dt;
+        }
+    }
+
+#if GRAVITY_X86
+    static void apply(const ForceParams& p, __m128 x, __m128 y, __m128 z, __m128& ux, __m128& uy, __m128& uz) {
+        const __m128 dt = _mm_set1_ps(p.dt), pull = _mm_set1_ps(200.0f);
+        __m128 tx = _mm_sub_ps(_mm_set1_ps(p.cursorX), x);
+        __m128 ty = _mm_sub_ps(_mm_set1_ps(p.cursorY), y);
+        __m128 tz = _mm_sub_ps(_mm_set1_ps(p.cursorZ), z);
+        __m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty)), _mm_mul_ps(tz, tz)));
+        __m128 k = _mm_div_ps(pull, len);
+        __m128 mask = _mm_cmpgt_ps(len, _mm_set1_ps(0.5f));
+        ux = _mm_add_ps(ux, _mm_and_ps(mask, _mm_mul_ps(_mm_mul_ps(_mm_div_ps(tx, len), k), dt)));
+        uy = _mm_add_ps(uy, _mm_and_ps(mask, _mm_mul_ps(_mm_mul_ps(_mm_div_ps(ty, len), k), dt)));
+        uz = _mm_add_ps(uz, _mm_and_ps(mask, _mm_mul_ps(_mm_mul_ps(_mm_div_ps(tz, len), k), dt)));
+    }
+
+    TARGET_AVX2
+    static void apply(const ForceParams& p, __m256 x, __m256 y, __m256 z, __m256& ux, __m256& uy, __m256& uz) {
+        const __m256 dt = _mm256_set1_ps(p.dt), pull = _mm256_set1_ps(200.0f);
+        __m256 tx = _mm256_sub_ps(_mm256_set1_ps(p.cursorX), x);
+        __m256 ty = _mm256_sub_ps(_mm256_set1_ps(p.cursorY), y);
+        __m256 tz = _mm256_sub_ps(_mm256_set1_ps(p.cursorZ), z);
+        __m256 len = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty)), _mm256_mul_ps(tz, tz)));
+        __m256 k = _mm256_div_ps(pull, len);
+        __m256 mask = _mm256_cmp_ps(len, _mm256_set1_ps(0.5f), _CMP_GT_OQ);
+        ux = _mm256_add_ps(ux, _mm256_and_ps(mask, _mm256_mul_ps(_mm256_mul_ps(_mm256_div_ps(tx, len), k), dt)));
+        uy = _mm256_add_ps(uy, _mm256_and_ps(mask, _mm256_mul_ps(_mm256_mul_ps(_mm256_div_ps(ty, len), k), dt)));
+        uz = _mm256_add_ps(uz, _mm256_and_ps(mask, _mm256_mul_ps(_mm256_mul_ps(_mm256_div_ps(tz, len), k), dt)));
+    }
+#endif
+};
+
+struct MagneticWallField {
+    static bool active(const ForceParams& p) { return p.magnetic; }
+
+    static void apply(const ForceParams& p, float x, float y, float z, float& ux, float& uy, float& uz) {
+        float dt = p.dt;
+        float w = p.boxSize;
+        float d1, d2;
+        d1 = std::fabs(-w - x); d2 = std::fabs(w - x);
+        ux += (1.0f / (d1 * d1 + 0.1f) - 1.0f / (d2 * d2 + 0.1f)) * 200.0f * dt;
+        d1 = std::fabs(-w - y); d2 = std::fabs(w - y);
+        uy += (1.0f / (d1 * d1 + 0.1f) - 1.0f / (d2 * d2 + 0.1f)) * 200.0f * dt;
+        d1 = std::fabs(-w - z); d2 = std::fabs(w - z);
+        uz += (1.0f / (d1 * d1 + 0.1f) - 1.0f / (d2 * d2 + 0.1f)) * 200.0f * dt;
+    }
+
+#if GRAVITY_X86
+    static void apply(const ForceParams& p, __m128 x, __m128 y, __m128 z, __m128& ux, __m128& uy, __m128& uz) {
+        const __m128 dt = _mm_set1_ps(p.dt), one = _mm_set1_ps(1.0f);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const __m128 wall = _mm_set1_ps(p.boxSize), negWall = _mm_set1_ps(-p.boxSize);
+        const __m128 soft = _mm_set1_ps(0.1f), pull = _mm_set1_ps(200.0f);
+        __m128* axes[3] = { &ux, &uy, &uz };
+        __m128 pos[3] = { x, y, z };
+        for (int a = 0; a < 3; ++a) {
+            __m128 d1 = _mm_and_ps(absMask, _mm_sub_ps(negWall, pos[a]));
+            __m128 d2 = _mm_and_ps(absMask, _mm_sub_ps(wall, pos[a]));
+            __m128 f = _mm_sub_ps(_mm_div_ps(one, _mm_add_ps(_mm_mul_ps(d1, d1), soft)),
+                                  _mm_div_ps(one, _mm_add_ps(_mm_mul_ps(d2, d2), soft)));
+            *axes[a] = _mm_add_ps(*axes[a], _mm_mul_ps(_mm_mul_ps(f, pull), dt));
+        }
+    }
+
+    TARGET_AVX2
+    static void apply(const ForceParams& p, __m256 x, __m256 y, __m256 z, __m256& ux, __m256& uy, __m256& uz) {
+        const __m256 dt = _mm256_set1_ps(p.dt), one = _mm256_set1_ps(1.0f);
+        const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        const __m256 wall = _mm256_set1_ps(p.boxSize), negWall = _mm256_set1_ps(-p.boxSize);
+        const __m256 soft = _mm256_set1_ps(0.1f), pull = _mm256_set1_ps(200.0f);
+        __m256* axes[3] = { &ux, &uy, &uz };
+        __m256 pos[3] = { x, y, z };
+        for (int a = 0; a < 3; ++a) {
+            __m256 d1 = _mm256_and_ps(absMask, _mm256_sub_ps(negWall, pos[a]));
+            __m256 d2 = _mm256_and_ps(absMask, _mm256_sub_ps(wall, pos[a]));
+            __m256 f = _mm256_sub_ps(_mm256_div_ps(one, _mm256_add_ps(_mm256_mul_ps(d1, d1), soft)),
+                                     _mm256_div_ps(one, _mm256_add_ps(_mm256_mul_ps(d2, d2), soft)));
+            *axes[a] = _mm256_add_ps(*axes[a], _mm256_mul_ps(_mm256_mul_ps(f, pull), dt));
+        }
+    }
+#endif
+};
+
+template <typename... Fields>
+struct FieldList {};
+
+// Every optional field, in the order they are applied; bit k of a field mask
+// selects the k-th entry
+using AllFields = FieldList<BlackHoleField, CursorField, MagneticWallField>;
+
+// Keeps the fields of List whose bit is set in Mask
+template <unsigned Mask, typename List, typename Out = FieldList<>>
+struct SelectFields;
+
+template <unsigned Mask, typename... Out>
+struct SelectFields<Mask, FieldList<>, FieldList<Out...>> {
+    using type = FieldList<Out...>;
+};
+
+template <unsigned Mask, typename Field, typename... Rest, typename... Out>
+struct SelectFields<Mask, FieldList<Field, Rest...>, FieldList<Out...>> {
+    using type = typename SelectFields<(Mask >> 1), FieldList<Rest...>,
+                                       typename std::conditional<(Mask & 1) != 0, FieldList<Out..., Field>, FieldList<Out...>>::type>::type;
+};
+
+template <typename... Fields>
+static unsigned activeMask(const ForceParams& p, FieldList<Fields...>) {
+    unsigned mask = 0, bit = 1;
+    ((mask |= Fields::active(p) ? bit : 0, bit <<= 1), ...);
+    return mask;
+}
+
+// ------------------ Kernels -------------------
+// One instantiation per field combination. Gravity, friction and the Euler
+// step are always on and run after the fields, as in the scalar reference.
+template <typename List>
+struct Kernels;
+
+template <typename... Fields>
+struct Kernels<FieldList<Fields...>> {
+    // Also used for the tail that does not fill a whole vector
+    static void scalar(const ForceParams& p, float* px, float* py, float* pz,
+                       float* vx, float* vy, float* vz, size_t begin, size_t end) {
+        float dt = p.dt;
+        float damping = 1.0f - p.friction * dt;
+        for (size_t i = begin; i < end; ++i) {
+            float x = px[i], y = py[i], z = pz[i];
+            float ux = vx[i], uy = vy[i], uz = vz[i];
+            (Fields::apply(p, x, y, z, ux, uy, uz), ...);
+
+            uy += p.gravity * dt;
+            ux *= damping; uy *= damping; uz *= damping;
+            px[i] = x + ux * dt;
+            py[i] = y + uy * dt;
+            pz[i] = z + uz * dt;
+            vx[i] = ux; vy[i] = uy; vz[i] = uz;
+        }
+    }
+
+#if GRAVITY_X86
+    static void sse2(const ForceParams& p, float* px, float* py, float* pz,
+                     float* vx, float* vy, float* vz, size_t begin, size_t end) {
+        const __m128 dt = _mm_set1_ps(p.dt);
+        const __m128 damping = _mm_set1_ps(1.0f - p.friction * p.dt);
+        const __m128 gdt = _mm_set1_ps(p.gravity * p.dt);
+
+        size_t i = begin;
+        for (; i + 4 <= end; i += 4) {
+            __m128 x = _mm_loadu_ps(px + i), y = _mm_loadu_ps(py + i), z = _mm_loadu_ps(pz + i);
+            __m128 ux = _mm_loadu_ps(vx + i), uy = _mm_loadu_ps(vy + i), uz = _mm_loadu_ps(vz + i);
+            (Fields::apply(p, x, y, z, ux, uy, uz), ...);
+
+            uy = _mm_add_ps(uy, gdt);
+            ux = _mm_mul_ps(ux, damping);
+            uy = _mm_mul_ps(uy, damping);
+            uz = _mm_mul_ps(uz, damping);
+            _mm_storeu_ps(px + i, _mm_add_ps(x, _mm_mul_ps(ux, dt)));
+            _mm_storeu_ps(py + i, _mm_add_ps(y, _mm_mul_ps(uy, dt)));
+            _mm_storeu_ps(pz + i, _mm_add_ps(z, _mm_mul_ps(uz, dt)));
+            _mm_storeu_ps(vx + i, ux);
+            _mm_storeu_ps(vy + i, uy);
+            _mm_storeu_ps(vz + i, uz);
+        }
+        scalar(p, px, py, pz, vx, vy, vz, i, end);
+    }
+
+    TARGET_AVX2
+    static void avx2(const ForceParams& p, float* px, float* py, float* pz,
+                     float* vx, float* vy, float* vz, size_t begin, size_t end) {
+        const __m256 dt = _mm256_set1_ps(p.dt);
+        const __m256 damping = _mm256_set1_ps(1.0f - p.friction * p.dt);
+        const __m256 gdt = _mm256_set1_ps(p.gravity * p.dt);
+
+        size_t i = begin;
+        for (; i + 8 <= end; i += 8) {
+            __m256 x = _mm256_loadu_ps(px + i), y = _mm256_loadu_ps(py + i), z = _mm256_loadu_ps(pz + i);
+            __m256 ux = _mm256_loadu_ps(vx + i), uy = _mm256_loadu_ps(vy + i), uz = _mm256_loadu_ps(vz + i);
+            (Fields::apply(p, x, y, z, ux, uy, uz), ...);
+
+            uy = _mm256_add_ps(uy, gdt);
+            ux = _mm256_mul_ps(ux, damping);
+            uy = _mm256_mul_ps(uy, damping);
+            uz = _mm256_mul_ps(uz, damping);
+            _mm256_storeu_ps(px + i, _mm256_add_ps(x, _mm256_mul_ps(ux, dt)));
+            _mm256_storeu_ps(py + i, _mm256_add_ps(y, _mm256_mul_ps(uy, dt)));
+            _mm256_storeu_ps(pz + i, _mm256_add_ps(z, _mm256_mul_ps(uz, dt)));
+            _mm256_storeu_ps(vx + i, ux);
+            _mm256_storeu_ps(vy + i, uy);
+            _mm256_storeu_ps(vz + i, uz);
+        }
+        scalar(p, px, py, pz, vx, vy, vz, i, end);
+    }
+#endif
+};
+
+// ------------------ Dispatch -------------------
+// Table of every (field mask, level) kernel, built from AllFields
+template <size_t... Masks>
+static ForceKernel lookupKernel(SimdLevel level, unsigned mask, std::index_sequence<Masks...>) {
+    static const ForceKernel table[][3] = {
+#if GRAVITY_X86
+        { &Kernels<typename SelectFields<Masks, AllFields>::type>::scalar,
+          &Kernels<typename SelectFields<Masks, AllFields>::type>::sse2,
+          &Kernels<typename SelectFields<Masks, AllFields>::type>::avx2 }...
+#else
+        { &Kernels<typename SelectFields<Masks, AllFields>::type>::scalar,
+          &Kernels<typename SelectFields<Masks, AllFields>::type>::scalar,
+          &Kernels<typename SelectFields<Masks, AllFields>::type>::scalar }...
+#endif
+    };
+    return table[mask][level];
+}
+
+template <typename... Fields>
+static constexpr size_t fieldCount(FieldList<Fields...>) { return sizeof...(Fields); }
+
+ForceKernel selectForceKernel(SimdLevel level, const ForceParams& p) {
+    constexpr size_t combinations = size_t(1) << fieldCount(AllFields());
+    return lookupKernel(resolveSimdLevel(level), activeMask(p, AllFields()), std::make_index_sequence<combinations>());
+}
+
+void integrateForces(SimdLevel level, const ForceParams& p, float* px, float* py, float* pz,
+                     float* vx, float* vy, float* vz, size_t begin, size_t end) {
+    selectForceKernel(level, p)(p, px, py, pz, vx, vy, vz, begin, end);
+}
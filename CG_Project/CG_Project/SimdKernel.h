@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include <cstddef>
+
+// ------------------ SIMD Force Kernel -------------------
+// Vectorised force-and-integrate kernels over the BallSystem arrays. They
+// apply the black hole, cursor and magnetic wall pulls, gravity, friction
+// and the Euler step 4 (SSE2) or 8 (AVX2) balls at a time. The operations
+// run in the same order as the scalar reference, so positions and
+// velocities match it bit for bit except that -0 may come out as +0.
+// There is one kernel per level and combination of active force modes;
+// pick it once per step with selectForceKernel. The entropy jitter is not
+// part of the kernel.
+enum SimdLevel {
+    SimdScalar,
+    SimdSSE2,
+    SimdAVX2,
+    SimdAuto      // best level the CPU supports
+};
+
+struct ForceParams {
+    float dt;
+    float gravity;
+    float friction;
+    float boxSize;
+    bool blackHole;
+    bool cursor;
+    bool magnetic;
+    float cursorX, cursorY, cursorZ;
+};
+
+// Highest level supported by this CPU and build
+SimdLevel detectSimdLevel();
+
+// Resolves SimdAuto and clamps requests the CPU cannot run
+SimdLevel resolveSimdLevel(SimdLevel requested);
+
+const char* simdLevelName(SimdLevel level);
+
+// Integrates balls [begin, end) of the given arrays in place
+using ForceKernel = void (*)(const ForceParams& p, float* px, float* py, float* pz,
+                             float* vx, float* vy, float* vz, size_t begin, size_t end);
+
+// Kernel for the level and the force modes enabled in p; no mode is tested per ball
+ForceKernel selectForceKernel(SimdLevel level, const ForceParams& p);
+
+// Selects and runs the kernel in one call
+void integrateForces(SimdLevel level, const ForceParams& p, float* px, float* py, float* pz,
+                     float* vx, float* vy, float* vz, size_t begin, size_t end);
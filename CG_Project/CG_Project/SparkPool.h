@@ -0,0 +1,79 @@
+﻿#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "Vec3.h"
+
+// ------------------ Sparkles -------------------
+// Fixed-capacity spark pool in structure-of-arrays form. Live sparks are kept
+// packed at the front; expired ones are swap-removed. Explosions that would
+// exceed the per-step or global budget are coalesced down to what is left.
+struct SparkPool {
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> life, g;   // red is always 1, blue always 0
+    size_t live = 0;
+    int stepBudget = 2000;        // most sparks spawned in a single step
+    int spawnedThisStep = 0;
+    size_t droppedLastStep = 0;
+    size_t droppedTotal = 0;
+
+    size_t size() const { return live; }
+    size_t capacity() const { return px.size(); }
+
+    // Capacity is the global budget: most sparks alive at once
+    void init(size_t capacity, int budget) {
+        px.assign(capacity, 0); py.assign(capacity, 0); pz.assign(capacity, 0);
+        vx.assign(capacity, 0); vy.assign(capacity, 0); vz.assign(capacity, 0);
+        life.assign(capacity, 0); g.assign(capacity, 0);
+        live = 0;
+        stepBudget = budget;
+    }
+
+    void beginStep() {
+        spawnedThisStep = 0;
+        droppedLastStep = 0;
+    }
+
+    // Number of sparks an explosion of the given size may actually spawn
+    int grant(int count) {
+        int stepLeft = std::max(0, stepBudget - spawnedThisStep);
+        int poolLeft = static_cast<int>(capacity() - live);
+        int allowed = std::min(count, std::min(stepLeft, poolLeft));
+        droppedLastStep += count - allowed;
+        droppedTotal += count - allowed;
+        spawnedThisStep += allowed;
+        return allowed;
+    }
+
+    void spawn(const Vec3& p, const Vec3& v, float green) {
+        size_t i = live++;
+        px[i] = p.x; py[i] = p.y; pz[i] = p.z;
+        vx[i] = v.x; vy[i] = v.y; vz[i] = v.z;
+        life[i] = 1.0f;
+        g[i] = green;
+    }
+
+    void update(float dt, float gravity) {
+        float dvy = gravity * dt * 0.1f;
+        for (size_t i = 0; i < live;) {
+            life[i] -= dt;
+            vy[i] += dvy;
+            px[i] += vx[i] * dt;
+            py[i] += vy[i] * dt;
+            pz[i] += vz[i] * dt;
+            if (life[i] <= 0) {
+                size_t last = --live;
+                px[i] = px[last]; py[i] = py[last]; pz[i] = pz[last];
+                vx[i] = vx[last]; vy[i] = vy[last]; vz[i] = vz[last];
+                life[i] = life[last];
+                g[i] = g[last];
+                continue;   // re-examine the spark moved into slot i
+            }
+            ++i;
+        }
+    }
+
+    void clear() { live = 0; }
+};
@@ -0,0 +1,88 @@
+﻿#include "Spawn.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "World.h"
+
+// Lattice over the clipped spawn region
+struct Lattice {
+    float cell;
+    Vec3 origin;
+    size_t nx, ny, nz;
+
+    Lattice(const World& world, const SpawnParams& p) {
+        cell = 2.0f * p.maxRadius;
+        float box = world.boxSize;
+        Vec3 lo(std::max(p.lo.x, -box), std::max(p.lo.y, -box), std::max(p.lo.z, -box));
+        Vec3 hi(std::min(p.hi.x, box), std::min(p.hi.y, box), std::min(p.hi.z, box));
+        origin = lo;
+        nx = cells(hi.x - lo.x);
+        ny = cells(hi.y - lo.y);
+        nz = cells(hi.z - lo.z);
+    }
+
+    size_t cells(float extent) const { return extent > cell ? static_cast<size_t>(extent / cell) : 0; }
+    size_t capacity() const { return nx * ny * nz; }
+};
+
+// Random numbers drawn per ball
+enum SpawnDraw { DrawX, DrawY, DrawZ, DrawRadius, DrawVx, DrawVz, DrawR, DrawG, DrawB, DrawCount };
+
+static const size_t spawnGrain = 4096;
+
+size_t spawnCapacity(const World& world, const SpawnParams& params) {
+    return Lattice(world, params).capacity();
+}
+
+float spawnBoxSize(size_t count, const SpawnParams& params) {
+    size_t side = static_cast<size_t>(std::ceil(std::cbrt(static_cast<double>(count))));
+    while (side * side * side < count)
+        ++side;
+    // A little slack so rounding never loses a row of cells
+    return side * params.maxRadius * 1.001f;
+}
+
+SpawnReport spawnBalls(World& world, const SpawnParams& params) {
+    auto start = std::chrono::steady_clock::now();
+    SpawnReport report;
+    Lattice lattice(world, params);
+    report.capacity = lattice.capacity();
+    size_t n = std::min(params.count, report.capacity);
+    report.placed = n;
+
+    BallSystem& balls = world.balls;
+    balls.reserve(balls.size() + n);
+    size_t first = balls.grow(n);
+
+    // One draw from the spawn stream keys the whole batch, so successive spawns differ
+    uint64_t key = params.fixedKey ? params.key : world.spawnRng.next();
+    report.key = key;
+    world.pool.parallelFor(n, spawnGrain, [&](size_t begin, size_t end, size_t) {
+        for (size_t k = begin; k < end; ++k) {
+            uint64_t counter = key + k * DrawCount;
+            auto draw = [counter](int d) { return Rng::toUnit(Rng::mix(counter + d)); };
+
+            // Even stride through the lattice, x fastest
+            size_t c = n < report.capacity ? static_cast<size_t>(k * (static_cast<double>(report.capacity) / n)) : k;
+            size_t cx = c % lattice.nx, cy = c / lattice.nx % lattice.ny, cz = c / (lattice.nx * lattice.ny);
+
+            float r = params.minRadius + (params.maxRadius - params.minRadius) * draw(DrawRadius);
+            float room = (lattice.cell * 0.5f - r) * params.jitter;
+            size_t i = first + k;
+            balls.px[i] = lattice.origin.x + (cx + 0.5f) * lattice.cell + (draw(DrawX) * 2 - 1) * room;
+            balls.py[i] = lattice.origin.y + (cy + 0.5f) * lattice.cell + (draw(DrawY) * 2 - 1) * room;
+            balls.pz[i] = lattice.origin.z + (cz + 0.5f) * lattice.cell + (draw(DrawZ) * 2 - 1) * room;
+            balls.vx[i] = (draw(DrawVx) * 2 - 1) * params.speed;
+            balls.vy[i] = 0;
+            balls.vz[i] = (draw(DrawVz) * 2 - 1) * params.speed;
+            balls.radius[i] = r;
+            balls.invMass[i] = 1.0f / (r * r * r);
+            balls.color[i] = { draw(DrawR), draw(DrawG), draw(DrawB) };
+        }
+    });
+
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return report;
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Vec3.h"
+
+struct World;
+
+// ------------------ Bulk Spawning -------------------
+// Places many balls at once without overlap. The spawn region is tiled with a
+// cubic lattice whose cells fit the largest ball; each ball takes one cell and
+// is jittered inside it, so no two balls can touch. When fewer balls than
+// cells are asked for, cells are picked at an even stride through the
+// lattice. Every value is drawn from a counter keyed by the ball index, so
+// the arrays are filled in parallel and the layout depends only on the seed.
+struct SpawnParams {
+    size_t count = 0;
+    float minRadius = 0.4f, maxRadius = 0.85f;
+    float speed = 1.0f;           // horizontal velocities uniform in [-speed, speed)
+    float jitter = 1.0f;          // share of each cell's free space used for jitter
+    Vec3 lo = Vec3(-1e30f, -1e30f, -1e30f);   // spawn region, clipped to the box
+    Vec3 hi = Vec3(1e30f, 1e30f, 1e30f);
+    bool fixedKey = false;        // reuse key instead of drawing one, to repeat an earlier spawn
+    uint64_t key = 0;
+};
+
+struct SpawnReport {
+    size_t placed = 0;            // fewer than asked for when the region is full
+    size_t capacity = 0;          // lattice cells in the region
+    double seconds = 0;           // wall time of the whole spawn
+    uint64_t key = 0;             // counter key the batch was drawn from
+};
+
+// Lattice cells available for params in the world's box
+size_t spawnCapacity(const World& world, const SpawnParams& params);
+
+// Half-size of the smallest box whose lattice holds count balls of params;
+// set world.boxSize to at least this before initWorld
+float spawnBoxSize(size_t count, const SpawnParams& params);
+
+SpawnReport spawnBalls(World& world, const SpawnParams& params);
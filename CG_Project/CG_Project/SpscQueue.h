@@ -0,0 +1,36 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// ------------------ SPSC Queue -------------------
+// Bounded lock-free ring for exactly one producer thread and one consumer
+// thread. Capacity must be a power of two; push fails when the ring is full.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+    bool push(const T& value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity)
+            return false;
+        items[t & (Capacity - 1)] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+        value = items[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T items[Capacity];
+    alignas(64) std::atomic<size_t> head{ 0 };   // next slot to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail{ 0 };   // next slot to push, written by the producer
+};
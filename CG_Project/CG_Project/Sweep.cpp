@@ -0,0 +1,379 @@
+﻿// Sweep.cpp : Runs a parameter sweep as many independent worlds across all cores.
+//
+// Every run owns its World (single-threaded, seeded), so runs share nothing
+// and their results do not depend on --jobs. Runs are dealt to a thread pool
+// one at a time; per-run metrics go to CSV and, with the sampled kinetic
+// energy curve, to JSON.
+//
+// Usage: gravity_sweep SPEC [--jobs N] [--csv FILE] [--json FILE]
+//
+// The spec is plain text, one directive per line; '#' starts a comment.
+//   balls 2000              fixed settings
+//   steps 600
+//   dt 0.016667
+//   sample 10               kinetic energy sampled every N steps
+//   seeds 1 2 3             every configuration runs once per seed
+//   gravity -9.8 -4.9       several values make a grid axis
+//   friction 0.1
+//   restitution 0.5 0.9
+//   entropy 0
+//   timescale 1 2
+//   scenario calm gravity=-4.9 restitution=0.5
+// With scenario lines the runs are the scenarios instead of the grid; a key a
+// scenario leaves out takes the first value of its axis.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Spawn.h"
+#include "ThreadPool.h"
+#include "World.h"
+
+// ------------------ Sweep Spec -------------------
+enum SweepParam { ParamGravity, ParamFriction, ParamRestitution, ParamEntropy, ParamTimeScale, ParamCount };
+
+static const char* paramNames[ParamCount] = { "gravity", "friction", "restitution", "entropy", "timescale" };
+
+struct RunConfig {
+    std::string name;
+    unsigned long long seed = 1;
+    float params[ParamCount] = {};
+};
+
+struct SweepSpec {
+    int balls = 1000;
+    int steps = 600;
+    float dt = 1.0f / 60.0f;
+    int sample = 10;
+    std::vector<unsigned long long> seeds = { 1 };
+    std::vector<float> axes[ParamCount] = { { -9.8f }, { 0.1f }, { 0.9f }, { 0.0f }, { 1.0f } };
+    std::vector<RunConfig> scenarios;     // seed unset; expanded over seeds
+};
+
+static int paramIndex(const std::string& name) {
+    for (int p = 0; p < ParamCount; ++p)
+        if (name == paramNames[p])
+            return p;
+    return -1;
+}
+
+static bool parseSpec(std::istream& in, SweepSpec& spec) {
+    std::string line;
+    std::vector<std::string> scenarioLines;
+    std::vector<int> scenarioLineNumbers;
+    for (int number = 1; std::getline(in, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string key;
+        if (!(words >> key))
+            continue;
+
+        bool ok = true;
+        int param = paramIndex(key);
+        if (key == "balls")
+            ok = static_cast<bool>(words >> spec.balls) && spec.balls >= 0;
+        else if (key == "steps")
+            ok = static_cast<bool>(words >> spec.steps) && spec.steps >= 0;
+        else if (key == "dt")
+            ok = static_cast<bool>(words >> spec.dt) && spec.dt > 0;
+        else if (key == "sample")
+            ok = static_cast<bool>(words >> spec.sample) && spec.sample >= 1;
+        else if (key == "seeds") {
+            spec.seeds.clear();
+            unsigned long long seed;
+            while (words >> seed)
+                spec.seeds.push_back(seed);
+            ok = !spec.seeds.empty() && words.eof();
+        }
+        else if (param >= 0) {
+            spec.axes[param].clear();
+            float value;
+            while (words >> value)
+                spec.axes[param].push_back(value);
+            ok = !spec.axes[param].empty() && words.eof();
+        }
+        else if (key == "scenario") {
+            // Resolved once every axis is known
+            scenarioLines.push_back(line);
+            scenarioLineNumbers.push_back(number);
+        }
+        else
+            ok = false;
+        if (!ok) {
+            std::cerr << "spec line " << number << ": cannot parse \"" << line << "\"\n";
+            return false;
+        }
+    }
+
+    for (size_t s = 0; s < scenarioLines.size(); ++s) {
+        std::istringstream words(scenarioLines[s]);
+        std::string key, setting;
+        RunConfig run;
+        words >> key;
+        bool ok = static_cast<bool>(words >> run.name) && run.name.find('=') == std::string::npos;
+        for (int p = 0; p < ParamCount; ++p)
+            run.params[p] = spec.axes[p].front();
+        while (ok && words >> setting) {
+            size_t eq = setting.find('=');
+            int param = eq == std::string::npos ? -1 : paramIndex(setting.substr(0, eq));
+            char* end = nullptr;
+            if (param >= 0)
+                run.params[param] = strtof(setting.c_str() + eq + 1, &end);
+            ok = param >= 0 && end && *end == '\0' && end != setting.c_str() + eq + 1;
+        }
+        if (!ok) {
+            std::cerr << "spec line " << scenarioLineNumbers[s] << ": expected \"scenario NAME key=value ...\"\n";
+            return false;
+        }
+        spec.scenarios.push_back(run);
+    }
+    return true;
+}
+
+// Scenarios, or the full grid, each repeated per seed
+static std::vector<RunConfig> expandRuns(const SweepSpec& spec) {
+    std::vector<RunConfig> configs = spec.scenarios;
+    if (configs.empty()) {
+        configs.push_back(RunConfig());
+        configs.back().name = "grid";
+        for (int p = 0; p < ParamCount; ++p) {
+            std::vector<RunConfig> next;
+            for (const RunConfig& c : configs)
+                for (float value : spec.axes[p]) {
+                    next.push_back(c);
+                    next.back().params[p] = value;
+                }
+            configs.swap(next);
+        }
+    }
+    std::vector<RunConfig> runs;
+    for (const RunConfig& c : configs)
+        for (unsigned long long seed : spec.seeds) {
+            runs.push_back(c);
+            runs.back().seed = seed;
+        }
+    return runs;
+}
+
+// ------------------ Runs -------------------
+struct RunResult {
+    double seconds = 0;
+    size_t pairsTested = 0;       // summed over every step
+    size_t contacts = 0;          // summed over every step
+    float timeToRest = -1;        // simulated seconds until the mean speed stayed below sleepSpeed; -1 = never
+    size_t finalBalls = 0;
+    std::vector<float> energy;    // kinetic energy at step 0, sample, 2 * sample, ...
+};
+
+static void sampleMotion(const BallSystem& balls, float& energy, float& meanSpeed) {
+    double e = 0, speed = 0;
+    for (size_t i = 0; i < balls.size(); ++i) {
+        double v2 = balls.vx[i] * balls.vx[i] + balls.vy[i] * balls.vy[i] + balls.vz[i] * balls.vz[i];
+        e += 0.5 * v2 / balls.invMass[i];
+        speed += std::sqrt(v2);
+    }
+    energy = static_cast<float>(e);
+    meanSpeed = balls.size() ? static_cast<float>(speed / balls.size()) : 0.0f;
+}
+
+static RunResult runOne(const SweepSpec& spec, const RunConfig& config) {
+    World world;
+    world.seed = config.seed;
+    world.globalGravity = config.params[ParamGravity];
+    world.globalFriction = config.params[ParamFriction];
+    world.restitution = config.params[ParamRestitution];
+    world.entropyLevel = config.params[ParamEntropy];
+    world.timeScale = config.params[ParamTimeScale];
+    world.threadCount = 1;
+    world.trailInterval = 0;
+    SpawnParams spawn;
+    spawn.count = spec.balls;
+    world.boxSize = std::max(world.boxSize, spawnBoxSize(spec.balls, spawn));
+    initWorld(world);
+    spawnBalls(world, spawn);
+
+    RunResult result;
+    float energy, meanSpeed;
+    bool resting = false;
+    float simulated = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s <= spec.steps; ++s) {
+        if (s > 0) {
+            float dt = spec.dt * world.timeScale;
+            updateSimulation(world, dt);
+            simulated += dt;
+            result.pairsTested += world.pairsTested;
+            result.contacts += world.contacts.size();
+        }
+        if (s % spec.sample == 0 || s == spec.steps) {
+            sampleMotion(world.balls, energy, meanSpeed);
+            if (s % spec.sample == 0)
+                result.energy.push_back(energy);
+            // Rest time is when the mean speed last dropped below the sleep speed
+            if (meanSpeed < world.sleepSpeed && !resting)
+                result.timeToRest = simulated;
+            resting = meanSpeed < world.sleepSpeed;
+        }
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!resting)
+        result.timeToRest = -1;
+    result.finalBalls = world.balls.size();
+    return result;
+}
+
+// ------------------ Output -------------------
+// RFC 4180: quote a field holding a comma, quote or line break, doubling inner quotes
+static std::string csvField(const std::string& s) {
+    if (s.find_first_of(",\"\r\n") == std::string::npos)
+        return s;
+    std::string out = "\"";
+    for (char ch : s)
+        out += ch == '"' ? std::string("\"\"") : std::string(1, ch);
+    return out + "\"";
+}
+
+static std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (unsigned char ch : s) {
+        if (ch == '"' || ch == '\\') {
+            out += '\\';
+            out += static_cast<char>(ch);
+        } else if (ch < 0x20) {
+            char esc[8];
+            snprintf(esc, sizeof esc, "\\u%04x", ch);
+            out += esc;
+        } else {
+            out += static_cast<char>(ch);
+        }
+    }
+    return out + "\"";
+}
+
+static void writeCsv(std::ostream& os, const SweepSpec& spec, const std::vector<RunConfig>& runs, const std::vector<RunResult>& results) {
+    os << "run,name,seed";
+    for (const char* p : paramNames)
+        os << "," << p;
+    os << ",balls,steps,seconds,steps_per_sec,pairs_tested,contacts,initial_energy,final_energy,time_to_rest\n";
+    for (size_t r = 0; r < runs.size(); ++r) {
+        const RunConfig& c = runs[r];
+        const RunResult& res = results[r];
+        os << r << "," << csvField(c.name) << "," << c.seed;
+        for (float v : c.params)
+            os << "," << v;
+        os << "," << res.finalBalls << "," << spec.steps << "," << res.seconds << "," << (res.seconds > 0 ? spec.steps / res.seconds : 0.0)
+           << "," << res.pairsTested << "," << res.contacts << "," << res.energy.front() << "," << res.energy.back() << "," << res.timeToRest << "\n";
+    }
+}
+
+static void writeJson(std::ostream& os, const SweepSpec& spec, const std::vector<RunConfig>& runs, const std::vector<RunResult>& results,
+                      int jobs, double wallSeconds) {
+    os << "{\n  \"jobs\": " << jobs << ", \"wall_seconds\": " << wallSeconds << ", \"balls\": " << spec.balls
+       << ", \"steps\": " << spec.steps << ", \"dt\": " << spec.dt << ", \"sample\": " << spec.sample << ",\n  \"runs\": [\n";
+    for (size_t r = 0; r < runs.size(); ++r) {
+        const RunConfig& c = runs[r];
+        const RunResult& res = results[r];
+        os << "    { \"run\": " << r << ", \"name\": " << jsonString(c.name) << ", \"seed\": " << c.seed;
+        for (int p = 0; p < ParamCount; ++p)
+            os << ", \"" << paramNames[p] << "\": " << c.params[p];
+        os << ", \"seconds\": " << res.seconds << ", \"steps_per_sec\": " << (res.seconds > 0 ? spec.steps / res.seconds : 0.0)
+           << ", \"pairs_tested\": " << res.pairsTested << ", \"contacts\": " << res.contacts << ", \"time_to_rest\": " << res.timeToRest
+           << ",\n      \"energy\": [";
+        for (size_t k = 0; k < res.energy.size(); ++k)
+            os << (k ? ", " : "") << res.energy[k];
+        os << "] }" << (r + 1 < runs.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+}
+
+// ------------------ Main Entry Point -------------------
+int main(int argc, char** argv) {
+    const char* specPath = nullptr;
+    int jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::string csvPath, jsonPath;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "--jobs") && hasValue)
+            jobs = atoi(argv[++i]);
+        else if (!strcmp(arg, "--csv") && hasValue)
+            csvPath = argv[++i];
+        else if (!strcmp(arg, "--json") && hasValue)
+            jsonPath = argv[++i];
+        else if (!specPath && arg[0] != '-')
+            specPath = arg;
+        else
+            ok = false;
+    }
+    if (!ok || !specPath || jobs < 1) {
+        std::cerr << "usage: gravity_sweep SPEC [--jobs N] [--csv FILE] [--json FILE]\n";
+        return 1;
+    }
+
+    std::ifstream specFile(specPath);
+    SweepSpec spec;
+    if (!specFile) {
+        std::cerr << "cannot read " << specPath << "\n";
+        return 1;
+    }
+    if (!parseSpec(specFile, spec))
+        return 1;
+
+    std::vector<RunConfig> runs = expandRuns(spec);
+    std::vector<RunResult> results(runs.size());
+    std::cerr << "running " << runs.size() << " worlds of " << spec.balls << " balls on " << jobs << " threads\n";
+
+    // Grain 1: one run per chunk, so idle threads steal whole runs
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool pool(jobs);
+    pool.parallelFor(runs.size(), 1, [&](size_t begin, size_t end, size_t) {
+        for (size_t r = begin; r < end; ++r)
+            results[r] = runOne(spec, runs[r]);
+    });
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double totalSteps = static_cast<double>(spec.steps) * runs.size();
+    std::cerr << "wall:        " << wall << " s\n";
+    std::cerr << "throughput:  " << (wall > 0 ? totalSteps / wall : 0.0) << " world-steps/sec\n";
+
+    int status = 0;
+    if (csvPath.empty() && jsonPath.empty()) {
+        writeCsv(std::cout, spec, runs, results);
+        if (!std::cout.flush()) {
+            std::cerr << "cannot write results to stdout\n";
+            status = 1;
+        }
+    }
+    if (!csvPath.empty()) {
+        std::ofstream file(csvPath);
+        if (file.is_open())
+            writeCsv(file, spec, runs, results);
+        file.close();
+        if (!file) {
+            std::cerr << "cannot write " << csvPath << "\n";
+            status = 1;
+        }
+    }
+    if (!jsonPath.empty()) {
+        std::ofstream file(jsonPath);
+        if (file.is_open())
+            writeJson(file, spec, runs, results, jobs, wall);
+        file.close();
+        if (!file) {
+            std::cerr << "cannot write " << jsonPath << "\n";
+            status = 1;
+        }
+    }
+    return status;
+}
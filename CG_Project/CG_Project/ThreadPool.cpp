@@ -0,0 +1,114 @@
+﻿#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads) { start(threads); }
+
+ThreadPool::~ThreadPool() { stop(); }
+
+void ThreadPool::resize(int threads) {
+    if (threads == size())
+        return;
+    stop();
+    start(threads);
+}
+
+void ThreadPool::start(int threads) {
+    threads = std::max(1, threads);
+    stopping = false;
+    for (int i = 0; i < threads; ++i)
+        queues.emplace_back(new Queue());
+    for (int i = 1; i < threads; ++i)
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+void ThreadPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (auto& t : workers)
+        t.join();
+    workers.clear();
+    queues.clear();
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const ChunkFn& fn) {
+    size_t chunks = chunkCount(count, grain);
+    if (chunks == 0)
+        return;
+    if (workers.empty() || chunks == 1) {
+        for (size_t c = 0; c < chunks; ++c)
+            fn(c * grain, std::min(count, (c + 1) * grain), c);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        job = &fn;
+        jobCount = count;
+        jobGrain = grain;
+        remaining = chunks;
+        for (size_t c = 0; c < chunks; ++c) {
+            Queue& q = *queues[c % queues.size()];
+            std::lock_guard<std::mutex> qlock(q.m);
+            q.chunks.push_back(c);
+        }
+        ++generation;
+    }
+    jobReady.notify_all();
+
+    while (runOne(0)) {
+    }
+
+    std::unique_lock<std::mutex> lock(jobMutex);
+    jobDone.wait(lock, [this] { return remaining == 0; });
+    job = nullptr;
+}
+
+// Pops a chunk from our own deque, or steals one from another thread's, and runs it
+bool ThreadPool::runOne(int id) {
+    size_t chunk = 0;
+    bool found = false;
+    int n = size();
+    for (int k = 0; k < n && !found; ++k) {
+        Queue& q = *queues[(id + k) % n];
+        std::lock_guard<std::mutex> lock(q.m);
+        if (q.chunks.empty())
+            continue;
+        if (k == 0) {
+            chunk = q.chunks.front();
+            q.chunks.pop_front();
+        }
+        else {
+            chunk = q.chunks.back();
+            q.chunks.pop_back();
+        }
+        found = true;
+    }
+    if (!found)
+        return false;
+
+    (*job)(chunk * jobGrain, std::min(jobCount, (chunk + 1) * jobGrain), chunk);
+    if (--remaining == 0) {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        jobDone.notify_all();
+    }
+    return true;
+}
+
+void ThreadPool::workerLoop(int id) {
+    unsigned long long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobReady.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        while (runOne(id)) {
+        }
+    }
+}
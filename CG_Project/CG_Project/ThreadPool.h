@@ -0,0 +1,58 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ------------------ Thread Pool -------------------
+// Work-stealing pool for data-parallel loops. parallelFor splits a range into
+// fixed-size chunks and deals them round-robin onto one deque per thread; each
+// thread drains its own deque from the front and steals from the back of the
+// others. The calling thread takes part, so a pool of size 1 runs inline.
+class ThreadPool {
+public:
+    // Called as fn(begin, end, chunkIndex); chunk boundaries depend only on
+    // count and grain, never on the thread count
+    using ChunkFn = std::function<void(size_t, size_t, size_t)>;
+
+    explicit ThreadPool(int threads = 1);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void resize(int threads);
+    int size() const { return static_cast<int>(queues.size()); }
+
+    static size_t chunkCount(size_t count, size_t grain) { return grain ? (count + grain - 1) / grain : 0; }
+
+    // Blocks until every chunk of [0, count) has run
+    void parallelFor(size_t count, size_t grain, const ChunkFn& fn);
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<size_t> chunks;
+    };
+
+    void start(int threads);
+    void stop();
+    void workerLoop(int id);
+    bool runOne(int id);
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues;   // queue 0 belongs to the calling thread
+
+    std::mutex jobMutex;
+    std::condition_variable jobReady, jobDone;
+    const ChunkFn* job = nullptr;
+    size_t jobCount = 0, jobGrain = 0;
+    unsigned long long generation = 0;
+    std::atomic<size_t> remaining{ 0 };
+    bool stopping = false;
+};
@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include <atomic>
+
+// ------------------ Triple Buffer -------------------
+// Lock-free handoff of whole values from one writer thread to one reader
+// thread. The writer fills back(), then publish() swaps it with the shared
+// middle slot; the reader's acquire() swaps the middle slot into front() only
+// if something new was published. Neither side ever waits, and the reader
+// always sees the newest complete value.
+template <typename T>
+class TripleBuffer {
+public:
+    T& back() { return slots[backIndex]; }
+
+    void publish() {
+        backIndex = middle.exchange(backIndex | freshBit, std::memory_order_acq_rel) & indexMask;
+    }
+
+    // Returns true if front() changed since the last call
+    bool acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & freshBit))
+            return false;
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+
+    const T& front() const { return slots[frontIndex]; }
+
+private:
+    static constexpr int indexMask = 3;
+    static constexpr int freshBit = 4;   // set while the middle slot holds an unread value
+
+    T slots[3];
+    int backIndex = 0;                   // owned by the writer
+    int frontIndex = 1;                  // owned by the reader
+    std::atomic<int> middle{ 2 };
+};
@@ -0,0 +1,35 @@
+﻿#pragma once
+
+#include <cmath>
+
+// ------------------ Vec3 -------------------
+// 3D vector class for position and velocity
+struct Vec3 {
+    float x, y, z;
+
+    // Constructor
+    Vec3(float x = 0, float y = 0, float z = 0) : x(x), y(y), z(z) {}
+
+    // Operator overloads for vector arithmetic
+    Vec3 operator+(const Vec3& b) const { return Vec3(x + b.x, y + b.y, z + b.z); }
+    Vec3 operator-(const Vec3& b) const { return Vec3(x - b.x, y - b.y, z - b.z); }
+    Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
+    Vec3 operator/(float s) const { return Vec3(x / s, y / s, z / s); }
+    Vec3& operator+=(const Vec3& b) {
+        x += b.x;
+        y += b.y;
+        z += b.z;
+        return *this;
+    }
+
+    // Normalization and length calculation
+    float length() const { return sqrt(x * x + y * y + z * z); }
+    Vec3 normalized() const {
+        float l = length();
+        return l > 0 ? *this / l : Vec3();
+    }
+
+    // Dot product and reflection
+    float dot(const Vec3& b) const { return x * b.x + y * b.y + z * b.z; }
+    Vec3 reflect(const Vec3& n) const { return *this - n * 2.0f * this->dot(n); }
+};
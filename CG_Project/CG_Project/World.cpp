@@ -0,0 +1,908 @@
+﻿#include "World.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Profiler.h"
+
+void initWorld(World& world) {
+    world.rng = Rng(world.seed);
+    world.spawnRng = RngStream(world.rng, Rng::stream(RngSpawn));
+    world.sparkRng = RngStream(world.rng, Rng::stream(RngSparks));
+    world.stepCount = 0;
+    world.balls.clear();
+    world.contactCache.clear();
+    world.balls.trails.configure(world.trailInterval, world.trailQuantized, world.boxSize);
+    world.sparks.init(world.sparkCapacity, world.sparkStepBudget);
+    world.pool.resize(world.threadCount);
+}
+
+void clearBalls(World& world) {
+    world.balls.clear();
+    world.sparks.clear();
+    world.contactCache.clear();
+    world.stepStartX.clear();
+    world.stepStartY.clear();
+    world.stepStartZ.clear();
+    world.sleepingBalls = 0;
+}
+
+// Balls per task for the per-ball loops, and grid cells per task for the collision solve
+static const size_t ballGrain = 2048;
+static const size_t cellGrain = 16;
+
+// ------------------ Simulation -------------------
+void spawnSparkExplosion(World& world, Vec3 position, int count) {
+    count = world.sparks.grant(count);
+    RngStream& rng = world.sparkRng;
+    for (int i = 0; i < count; ++i) {
+        Vec3 dir(rng.range(-1, 1), rng.range(-1, 1), rng.range(-1, 1));
+        float green = 0.5f + rng.uniform() * 0.5f;
+        world.sparks.spawn(position, dir * 3.0f, green);
+    }
+}
+
+// Entropy jitter is keyed by (step, ball id, axis), so it does not depend on
+// which thread integrates which ball, in what order, or at what index
+static uint64_t jitterKey(const World& world) { return world.rng.key(Rng::stream(RngJitter, world.stepCount)); }
+
+// Scalar reference: applies the active force modes, gravity, friction and
+// the entropy jitter one ball at a time
+static void integrateRangeScalar(World& world, float dt, size_t begin, size_t end) {
+    BallSystem& balls = world.balls;
+    uint64_t jitter = jitterKey(world);
+    for (size_t i = begin; i < end; ++i) {
+        Vec3 pos = balls.position(i);
+        Vec3 vel = balls.velocity(i);
+
+        if (world.blackHoleMode) {
+            Vec3 toCenter = Vec3(0, 0, 0) - pos;
+            float distSq = toCenter.length();
+            distSq = std::max(1.0f, distSq);
+            Vec3 pull = toCenter.normalized() * (100.0f / distSq);
+            vel += pull * dt;
+        }
+
+        if (world.cursorGravityMode) {
+            Vec3 toCursor = world.cursorWorldTarget - pos;
+            float distSq = toCursor.length();
+            if (distSq > 0.5f) {
+                Vec3 pull = toCursor.normalized() * (200.0f / distSq);
+                vel += pull * dt;
+            }
+        }
+
+        if (world.wallsAreMagnetic) {
+            float pullStrength = 200.0f;
+            float wallDist = world.boxSize;
+
+            Vec3 force(0, 0, 0);
+            float dX1 = fabs(-wallDist - pos.x);
+            float dX2 = fabs(wallDist - pos.x);
+            float dY1 = fabs(-wallDist - pos.y);
+            float dY2 = fabs(wallDist - pos.y);
+            float dZ1 = fabs(-wallDist - pos.z);
+            float dZ2 = fabs(wallDist - pos.z);
+
+            force.x += 1.0f / (dX1 * dX1 + 0.1f);
+            force.x -= 1.0f / (dX2 * dX2 + 0.1f);
+
+            force.y += 1.0f / (dY1 * dY1 + 0.1f);
+            force.y -= 1.0f / (dY2 * dY2 + 0.1f);
+
+            force.z += 1.0f / (dZ1 * dZ1 + 0.1f);
+            force.z -= 1.0f / (dZ2 * dZ2 + 0.1f);
+
+            vel += force * pullStrength * dt;
+        }
+
+        vel += Vec3(0, world.globalGravity, 0) * dt;
+        vel = vel * (1.0f - world.globalFriction * dt);
+        pos += vel * dt;
+        uint64_t counter = uint64_t(balls.id[i]) * 3;
+        vel.x += Rng::symmetric(jitter, counter + 0) * world.entropyLevel * 100.0f * dt;
+        vel.y += Rng::symmetric(jitter, counter + 1) * world.entropyLevel * 100.0f * dt;
+        vel.z += Rng::symmetric(jitter, counter + 2) * world.entropyLevel * 100.0f * dt;
+
+        balls.setPosition(i, pos);
+        balls.setVelocity(i, vel);
+    }
+}
+
+// Vector path: the force kernel chosen for this step does forces and
+// integration, then the entropy jitter is applied in a scalar pass (skipped
+// entirely when entropy is zero)
+static void integrateRangeSimd(World& world, ForceKernel kernel, const ForceParams& p, float dt, size_t begin, size_t end) {
+    BallSystem& balls = world.balls;
+    kernel(p, balls.px.data(), balls.py.data(), balls.pz.data(),
+           balls.vx.data(), balls.vy.data(), balls.vz.data(), begin, end);
+
+    if (world.entropyLevel == 0.0f)
+        return;
+
+    uint64_t jitter = jitterKey(world);
+    for (size_t i = begin; i < end; ++i) {
+        uint64_t counter = uint64_t(balls.id[i]) * 3;
+        balls.vx[i] += Rng::symmetric(jitter, counter + 0) * world.entropyLevel * 100.0f * dt;
+        balls.vy[i] += Rng::symmetric(jitter, counter + 1) * world.entropyLevel * 100.0f * dt;
+        balls.vz[i] += Rng::symmetric(jitter, counter + 2) * world.entropyLevel * 100.0f * dt;
+    }
+}
+
+// ------------------ Mutual Gravity -------------------
+// Pulls every ball towards every other ball. Accelerations are all computed
+// from the same positions before any velocity changes, so the result does not
+// depend on how the balls are split across threads.
+static const size_t nbodyGrain = 256;
+
+void applyMutualGravity(World& world, float dt) {
+    BallSystem& balls = world.balls;
+    size_t n = balls.size();
+    world.nbodyAx.resize(n);
+    world.nbodyAy.resize(n);
+    world.nbodyAz.resize(n);
+
+    if (!world.nbodyDirect)
+        world.octree.build(balls, world.boxSize, world.pool);
+
+    world.pool.parallelFor(n, nbodyGrain, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            Vec3 a = world.nbodyDirect
+                ? directAcceleration(balls, i, world.nbodyG, world.nbodySoftening)
+                : world.octree.acceleration(balls, i, world.nbodyTheta, world.nbodyG, world.nbodySoftening);
+            world.nbodyAx[i] = a.x;
+            world.nbodyAy[i] = a.y;
+            world.nbodyAz[i] = a.z;
+        }
+    });
+
+    world.pool.parallelFor(n, ballGrain, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            if (balls.sleeping[i])
+                continue;
+            balls.vx[i] += world.nbodyAx[i] * dt;
+            balls.vy[i] += world.nbodyAy[i] * dt;
+            balls.vz[i] += world.nbodyAz[i] * dt;
+        }
+    });
+}
+
+void integrateBalls(World& world, float dt) {
+    if (world.nbodyMode)
+        applyMutualGravity(world, dt);
+
+    // Each chunk integrates its runs of awake balls; sleeping balls keep
+    // their position and zero velocity
+    const std::vector<uint8_t>& sleeping = world.balls.sleeping;
+    SimdLevel level = resolveSimdLevel(world.simdLevel);
+
+    // Force modes are resolved to one specialised kernel for the whole step
+    ForceParams p;
+    p.dt = dt;
+    p.gravity = world.globalGravity;
+    p.friction = world.globalFriction;
+    p.boxSize = world.boxSize;
+    p.blackHole = world.blackHoleMode;
+    p.cursor = world.cursorGravityMode;
+    p.magnetic = world.wallsAreMagnetic;
+    p.cursorX = world.cursorWorldTarget.x;
+    p.cursorY = world.cursorWorldTarget.y;
+    p.cursorZ = world.cursorWorldTarget.z;
+    ForceKernel kernel = selectForceKernel(level, p);
+
+    world.pool.parallelFor(world.balls.size(), ballGrain, [&](size_t begin, size_t end, size_t) {
+        size_t i = begin;
+        while (i < end) {
+            while (i < end && sleeping[i])
+                ++i;
+            size_t run = i;
+            while (i < end && !sleeping[i])
+                ++i;
+            if (run == i)
+                continue;
+            if (level == SimdScalar)
+                integrateRangeScalar(world, dt, run, i);
+            else
+                integrateRangeSimd(world, kernel, p, dt, run, i);
+        }
+    });
+}
+
+void recordTrails(World& world) {
+    BallSystem& balls = world.balls;
+    if (!balls.trails.enabled() || balls.trails.stepCounter++ % balls.trails.interval != 0)
+        return;
+    world.pool.parallelFor(balls.size(), ballGrain, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i)
+            balls.trails.add(i, balls.position(i));
+    });
+}
+
+// ------------------ Collision Handling -------------------
+// Wall collisions: clamp the ball inside the box and remember which walls it
+// touched; the contact solve then handles the bounce
+static void clampToWalls(World& world, size_t i) {
+    BallSystem& balls = world.balls;
+    float boxSize = world.boxSize;
+    float r = balls.radius[i];
+    uint8_t faces = 0;
+    for (int j = 0; j < 3; ++j) {
+        float* coord = j == 0 ? &balls.px[i] : j == 1 ? &balls.py[i] : &balls.pz[i];
+        if (*coord - r < -boxSize) {
+            *coord = -boxSize + r;
+            faces |= 1 << (j * 2);
+        }
+        if (*coord + r > boxSize) {
+            *coord = boxSize - r;
+            faces |= 1 << (j * 2 + 1);
+        }
+    }
+    world.wallFaces[i] = faces;
+}
+
+// Contact detection: records an overlapping pair with its normal, masses and
+// bounce target; the solve applies the impulses afterwards. A sleeping ball
+// acts as immovable until an impact faster than wakeSpeed wakes it; two
+// sleeping balls are not tested at all. A new contact that is closing makes a
+// spark; one carried over from the last step is resting and does not.
+// Cache keys are the two ball ids, or a ball id and a wall face
+static uint64_t contactKey(const BallSystem& balls, const Contact& c) {
+    uint64_t ia = balls.id[c.a], ib = balls.id[c.b];
+    if (c.a == c.b)
+        return ia << 32 | (0xffffffffu - c.face);
+    return ia < ib ? ia << 32 | ib : ib << 32 | ia;
+}
+
+static float cachedImpulse(const World& world, const Contact& c) {
+    const std::vector<CachedContact>& cache = world.contactCache;
+    uint64_t key = contactKey(world.balls, c);
+    auto it = std::lower_bound(cache.begin(), cache.end(), key, [](const CachedContact& c, uint64_t k) { return c.key < k; });
+    return it != cache.end() && it->key == key ? it->impulse : -1.0f;
+}
+
+// Restitution for an approach at closingSpeed: slower approaches do not bounce.
+// Shared by the solver and the sweep so both follow the same rule.
+static float bounceFactor(const World& world, float closingSpeed) {
+    return closingSpeed > world.bounceSpeed ? world.restitution : 0.0f;
+}
+
+static bool isGhost(const World& world, size_t i) { return !world.ghosts.empty() && world.ghosts[i]; }
+
+// Whether this world solves the pair; see World::ghosts
+static bool solvesPair(const World& world, size_t a, size_t b) {
+    bool ghostA = isGhost(world, a), ghostB = isGhost(world, b);
+    if (ghostA == ghostB)
+        return !ghostA;
+    const std::vector<uint32_t>& id = world.balls.id;
+    return ghostA ? id[b] < id[a] : id[a] < id[b];
+}
+
+// Whether this world takes the contacts of a grid cell; see World::cellsFrom
+static bool solvesCell(const World& world, int cell) {
+    const SpatialGrid& grid = world.grid;
+    int cx, cy, cz;
+    grid.cellCoords(cell, cx, cy, cz);
+    float centre = -grid.boxSize + (cx + 0.5f) * grid.cellSize;
+    return centre >= world.cellsFrom && centre < world.cellsTo;
+}
+
+static void detectBallContact(World& world, size_t a, size_t b, std::vector<SparkEvent>& sparks, std::vector<Contact>& contacts) {
+    BallSystem& balls = world.balls;
+    bool sleepA = balls.sleeping[a], sleepB = balls.sleeping[b];
+    if (sleepA && sleepB)
+        return;
+
+    Vec3 posA = balls.position(a), posB = balls.position(b);
+    Vec3 delta = posB - posA;
+    float dist = delta.length();
+    float minDist = balls.radius[a] + balls.radius[b];
+    if (dist >= minDist || dist <= 0)
+        return;
+
+    Contact c(a, b);
+    c.normal = delta / dist;
+    float velAlongNormal = (balls.velocity(b) - balls.velocity(a)).dot(c.normal);
+    if ((sleepA || sleepB) && -velAlongNormal > world.wakeSpeed) {
+        balls.wake(sleepA ? a : b);
+        sleepA = sleepB = false;
+    }
+    c.invMassA = sleepA ? 0.0f : balls.invMass[a];
+    c.invMassB = sleepB ? 0.0f : balls.invMass[b];
+    c.target = -bounceFactor(world, -velAlongNormal) * velAlongNormal;
+
+    float cached = cachedImpulse(world, c);
+    if (cached >= 0 && world.warmStart)
+        c.impulse = cached;
+    if (cached < 0 && velAlongNormal < 0 && !sleepA && !sleepB)
+        sparks.push_back({ (posA + posB) * 0.5f, 15 });
+    contacts.push_back(c);
+}
+
+// A wall is an immovable partner: the contact's b is the ball itself and the
+// normal points from the ball into the wall
+static void addWallContacts(World& world, size_t i, std::vector<Contact>& contacts) {
+    BallSystem& balls = world.balls;
+    for (uint8_t face = 0; face < 6; ++face) {
+        if (!(world.wallFaces[i] & (1 << face)))
+            continue;
+        Contact c(i, i);
+        float sign = face & 1 ? 1.0f : -1.0f;
+        c.normal = Vec3(face / 2 == 0 ? sign : 0, face / 2 == 1 ? sign : 0, face / 2 == 2 ? sign : 0);
+        c.face = face;
+        c.invMassA = balls.invMass[i];
+        float velAlongNormal = -balls.velocity(i).dot(c.normal);
+        c.target = -bounceFactor(world, -velAlongNormal) * velAlongNormal;
+        float cached = cachedImpulse(world, c);
+        if (cached >= 0 && world.warmStart)
+            c.impulse = cached;
+        contacts.push_back(c);
+    }
+}
+
+// Tests ball i against every later-indexed ball in the 3x3x3 block around its cell
+static size_t collideWithNeighbours(World& world, size_t i, int cell, std::vector<SparkEvent>& sparks, std::vector<Contact>& contacts) {
+    const SpatialGrid& grid = world.grid;
+    int cx, cy, cz;
+    grid.cellCoords(cell, cx, cy, cz);
+    size_t pairs = 0;
+
+    for (int z = std::max(0, cz - 1); z <= std::min(grid.dim - 1, cz + 1); ++z)
+        for (int y = std::max(0, cy - 1); y <= std::min(grid.dim - 1, cy + 1); ++y)
+            for (int x = std::max(0, cx - 1); x <= std::min(grid.dim - 1, cx + 1); ++x) {
+                int n = grid.cellIndex(x, y, z);
+                for (int k = grid.cellStart[n]; k < grid.cellStart[n + 1]; ++k) {
+                    size_t j = grid.cellBalls[k];
+                    if (j > i) {
+                        ++pairs;
+                        detectBallContact(world, i, j, sparks, contacts);
+                    }
+                }
+            }
+    return pairs;
+}
+
+// ------------------ Contact Solver -------------------
+// Sequential impulses: every iteration walks the contacts and pushes each
+// pair's normal speed towards its target, keeping the accumulated impulse
+// non-negative. Warm-started impulses from the cache mean a resting stack
+// starts close to its answer, so the early-out usually fires after a couple
+// of iterations. Overlap is then removed by a few position passes.
+static const float positionCorrection = 0.8f;
+
+static float normalSpeed(const BallSystem& balls, const Contact& c) {
+    Vec3 velB = c.a == c.b ? Vec3() : balls.velocity(c.b);
+    return (velB - balls.velocity(c.a)).dot(c.normal);
+}
+
+static void applyImpulse(BallSystem& balls, const Contact& c, float impulse) {
+    balls.vx[c.a] -= c.normal.x * impulse * c.invMassA;
+    balls.vy[c.a] -= c.normal.y * impulse * c.invMassA;
+    balls.vz[c.a] -= c.normal.z * impulse * c.invMassA;
+    balls.vx[c.b] += c.normal.x * impulse * c.invMassB;
+    balls.vy[c.b] += c.normal.y * impulse * c.invMassB;
+    balls.vz[c.b] += c.normal.z * impulse * c.invMassB;
+}
+
+// Largest normal speed change made in the batch
+static float warmStart(World& world, size_t begin, size_t end) {
+    for (size_t k = begin; k < end; ++k) {
+        const Contact& c = world.contacts[k];
+        if (c.impulse > 0)
+            applyImpulse(world.balls, c, c.impulse);
+    }
+    return 0.0f;
+}
+
+static float solveVelocities(World& world, size_t begin, size_t end) {
+    BallSystem& balls = world.balls;
+    float change = 0;
+    for (size_t k = begin; k < end; ++k) {
+        Contact& c = world.contacts[k];
+        float velAlongNormal = normalSpeed(balls, c);
+        float invMassSum = c.invMassA + c.invMassB;
+        float impulse = std::max(0.0f, c.impulse + (c.target - velAlongNormal) / invMassSum);
+        float delta = impulse - c.impulse;
+        c.impulse = impulse;
+        applyImpulse(balls, c, delta);
+        change = std::max(change, std::fabs(delta) * invMassSum);
+    }
+    return change;
+}
+
+// Deepest overlap in the batch before this pass corrected it
+static float solvePositions(World& world, size_t begin, size_t end) {
+    BallSystem& balls = world.balls;
+    float deepest = 0;
+    for (size_t k = begin; k < end; ++k) {
+        const Contact& c = world.contacts[k];
+        if (c.a == c.b)
+            continue;
+        Vec3 posA = balls.position(c.a), posB = balls.position(c.b);
+        Vec3 delta = posB - posA;
+        float dist = delta.length();
+        float depth = balls.radius[c.a] + balls.radius[c.b] - dist;
+        deepest = std::max(deepest, depth);
+        if (depth <= world.penetrationSlop || dist <= 0)
+            continue;
+        Vec3 normal = delta / dist;
+        float push = (depth - world.penetrationSlop) * positionCorrection / (c.invMassA + c.invMassB);
+        balls.setPosition(c.a, posA - normal * (push * c.invMassA));
+        balls.setPosition(c.b, posB + normal * (push * c.invMassB));
+    }
+    return deepest;
+}
+
+// Deepest overlap left in the batch
+static float measurePenetration(const World& world, size_t begin, size_t end) {
+    const BallSystem& balls = world.balls;
+    float deepest = 0;
+    for (size_t k = begin; k < end; ++k) {
+        const Contact& c = world.contacts[k];
+        if (c.a == c.b)
+            continue;
+        float dist = (balls.position(c.b) - balls.position(c.a)).length();
+        deepest = std::max(deepest, balls.radius[c.a] + balls.radius[c.b] - dist);
+    }
+    return deepest;
+}
+
+// Runs fn(begin, end) over every batch, one colour at a time, and returns the
+// largest result. With an exchange set, every colour ends with one, so the
+// next colour starts from what every world did to the shared balls.
+template <typename BatchFn>
+static float forEachBatch(World& world, BatchFn fn, ExchangeStage stage, bool exchange = true) {
+    float largest = 0;
+    for (int color = 0; color < SpatialGrid::colors; ++color) {
+        size_t first = world.colorBatchStart[color];
+        size_t count = world.colorBatchStart[color + 1] - first;
+        world.pool.parallelFor(count, 1, [&](size_t begin, size_t end, size_t) {
+            for (size_t k = first + begin; k < first + end; ++k)
+                world.batchChange[k] = fn(world.batchStart[k], world.batchStart[k + 1]);
+        });
+        for (size_t k = first; k < first + count; ++k)
+            largest = std::max(largest, world.batchChange[k]);
+        if (world.exchange && exchange)
+            largest = world.exchange->exchange(world, stage, largest);
+    }
+    return largest;
+}
+
+static void solveContacts(World& world) {
+    BallSystem& balls = world.balls;
+    world.batchChange.assign(world.batchStart.size() - 1, 0.0f);
+
+    // Warm start, colour by colour like the iterations so that every ball
+    // takes its impulses in the same order however the contacts are split
+    size_t hits = 0;
+    for (const Contact& c : world.contacts)
+        hits += c.impulse > 0;
+    world.cacheHitRate = world.contacts.empty() ? 0.0f : static_cast<float>(hits) / world.contacts.size();
+    forEachBatch(world, [&](size_t begin, size_t end) { return warmStart(world, begin, end); }, ExchangeVelocities);
+
+    world.solverIterationsUsed = 0;
+    while (world.solverIterationsUsed < world.solverIterations) {
+        ++world.solverIterationsUsed;
+        if (forEachBatch(world, [&](size_t begin, size_t end) { return solveVelocities(world, begin, end); }, ExchangeVelocities) <=
+            world.solverTolerance)
+            break;
+    }
+
+    // Position passes stop once nothing overlaps by more than the slop
+    int passes = std::max(1, world.solverIterations / 2);
+    for (int pass = 0; pass < passes; ++pass)
+        if (forEachBatch(world, [&](size_t begin, size_t end) { return solvePositions(world, begin, end); }, ExchangePositions) <=
+            world.penetrationSlop)
+            break;
+    world.residualPenetration =
+        forEachBatch(world, [&](size_t begin, size_t end) { return measurePenetration(world, begin, end); }, ExchangePositions, false);
+
+    // The cache keeps this step's impulses for the pairs still touching
+    std::vector<CachedContact>& cache = world.contactCache;
+    cache.clear();
+    for (const Contact& c : world.contacts)
+        if (c.impulse > 0)
+            cache.push_back({ contactKey(balls, c), c.impulse });
+    std::sort(cache.begin(), cache.end(), [](const CachedContact& x, const CachedContact& y) { return x.key < y.key; });
+}
+
+// Wall clamping first, then contact detection over the grid (or every pair
+// on the reference path), then the contact solve
+void handleCollisions(World& world) {
+    BallSystem& balls = world.balls;
+    SpatialGrid& grid = world.grid;
+    world.pairsTested = 0;
+    world.contacts.clear();
+    world.batchStart.assign(1, 0);
+    world.colorBatchStart.assign(1, 0);
+
+    // Once the sweeps are exchanged every copy of a ball is the same, so
+    // ghosts are clamped here exactly as their owners clamp them
+    if (world.exchange)
+        world.exchange->exchange(world, ExchangeCollisions, 0.0f);
+    world.wallFaces.assign(balls.size(), 0);
+    world.pool.parallelFor(balls.size(), ballGrain, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i)
+            if (!balls.sleeping[i])
+                clampToWalls(world, i);
+    });
+    if (world.exchange)
+        world.exchange->begin(world);
+
+    if (!world.useSpatialHash) {
+        // Reference path: test every pair, single-threaded, as one batch
+        std::vector<SparkEvent> sparks;
+        for (size_t i = 0; i < balls.size(); ++i) {
+            if (!isGhost(world, i))
+                addWallContacts(world, i, world.contacts);
+            for (size_t j = i + 1; j < balls.size(); ++j) {
+                ++world.pairsTested;
+                if (solvesPair(world, i, j))
+                    detectBallContact(world, i, j, sparks, world.contacts);
+            }
+        }
+        for (const SparkEvent& e : sparks)
+            spawnSparkExplosion(world, e.pos, e.count);
+        world.batchStart.push_back(world.contacts.size());
+        world.colorBatchStart.resize(SpatialGrid::colors + 1, 1);
+        solveContacts(world);
+        return;
+    }
+
+    // Detection runs colour by colour; cells of one colour are scanned in
+    // parallel. Each chunk records its own pair count, contacts and spark
+    // requests, which are merged in chunk order so results do not depend on
+    // which thread ran which chunk. Each chunk's contacts become one batch.
+    grid.build(balls, world.boxSize, world.gridRadius);
+    for (int color = 0; color < SpatialGrid::colors; ++color) {
+        const int* cells = grid.colorCells.data() + grid.colorStart[color];
+        size_t cellCount = grid.colorStart[color + 1] - grid.colorStart[color];
+        size_t chunks = ThreadPool::chunkCount(cellCount, cellGrain);
+        if (world.chunkSparks.size() < chunks) {
+            world.chunkSparks.resize(chunks);
+            world.chunkPairs.resize(chunks);
+            world.chunkContacts.resize(chunks);
+        }
+
+        world.pool.parallelFor(cellCount, cellGrain, [&](size_t begin, size_t end, size_t chunk) {
+            std::vector<SparkEvent>& sparks = world.chunkSparks[chunk];
+            std::vector<Contact>& contacts = world.chunkContacts[chunk];
+            size_t pairs = 0;
+            sparks.clear();
+            contacts.clear();
+            for (size_t c = begin; c < end; ++c) {
+                int cell = cells[c];
+                if (!solvesCell(world, cell))
+                    continue;
+                for (int k = grid.cellStart[cell]; k < grid.cellStart[cell + 1]; ++k) {
+                    addWallContacts(world, grid.cellBalls[k], contacts);
+                    pairs += collideWithNeighbours(world, grid.cellBalls[k], cell, sparks, contacts);
+                }
+            }
+            world.chunkPairs[chunk] = pairs;
+        });
+
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            world.pairsTested += world.chunkPairs[chunk];
+            if (!world.chunkContacts[chunk].empty()) {
+                world.contacts.insert(world.contacts.end(), world.chunkContacts[chunk].begin(), world.chunkContacts[chunk].end());
+                world.batchStart.push_back(world.contacts.size());
+            }
+            for (const SparkEvent& e : world.chunkSparks[chunk])
+                spawnSparkExplosion(world, e.pos, e.count);
+        }
+        world.colorBatchStart.push_back(world.batchStart.size() - 1);
+    }
+    solveContacts(world);
+}
+
+// ------------------ Continuous Collision -------------------
+// A ball that moves more than ccdThreshold of its radius in a step can pass
+// through a thin neighbour or sink deep into a wall before the overlap test
+// sees it. Such balls are swept along their path from the start of the step:
+// the earliest impact against any ball near the path is resolved at the time
+// of impact and the rest of the step is replayed with the new velocities, and
+// a wall crossing is mirrored back instead of clamped. The pass runs on one
+// thread in ball order, so it is deterministic; the overlap solve that follows
+// cleans up anything it left touching.
+
+// Earliest t in [0, 1] at which two spheres moving linearly from d0 apart by
+// relative displacement dd come within minDist; -1 if they never do or start
+// overlapping (the overlap solve handles those)
+static float timeOfImpact(const Vec3& d0, const Vec3& dd, float minDist) {
+    float a = dd.dot(dd);
+    float b = 2.0f * d0.dot(dd);
+    float c = d0.dot(d0) - minDist * minDist;
+    if (c <= 0 || b >= 0 || a <= 0)
+        return -1;
+    float disc = b * b - 4 * a * c;
+    if (disc < 0)
+        return -1;
+    float t = (-b - std::sqrt(disc)) / (2 * a);
+    return t <= 1 ? t : -1;
+}
+
+static Vec3 stepStart(const World& world, size_t i) {
+    return Vec3(world.stepStartX[i], world.stepStartY[i], world.stepStartZ[i]);
+}
+
+// Impacts move balls after the sweep grid was built; their cells are not
+// updated, so searches widen by the furthest any ball has drifted instead
+static void relocateSwept(World& world, size_t i, const Vec3& to) {
+    BallSystem& balls = world.balls;
+    world.sweepDrift[i] += (to - balls.position(i)).length();
+    world.sweepMaxDrift = std::max(world.sweepMaxDrift, world.sweepDrift[i]);
+    balls.setPosition(i, to);
+}
+
+// Sweeps ball a against every ball within reach of its path and resolves the earliest impact
+static void sweepBall(World& world, size_t a, float reach, float dt) {
+    BallSystem& balls = world.balls;
+    const SpatialGrid& grid = world.grid;
+    Vec3 startA = stepStart(world, a), endA = balls.position(a);
+    float moveA = world.sweepMove[a];
+    float lo[3], hi[3];
+    for (int k = 0; k < 3; ++k) {
+        float s = k == 0 ? startA.x : k == 1 ? startA.y : startA.z;
+        float e = k == 0 ? endA.x : k == 1 ? endA.y : endA.z;
+        lo[k] = std::min(s, e) - reach;
+        hi[k] = std::max(s, e) + reach;
+    }
+
+    size_t hit = a;
+    float hitTime = 2;
+    for (int z = grid.coord(lo[2]); z <= grid.coord(hi[2]); ++z)
+        for (int y = grid.coord(lo[1]); y <= grid.coord(hi[1]); ++y)
+            for (int x = grid.coord(lo[0]); x <= grid.coord(hi[0]); ++x) {
+                int n = grid.cellIndex(x, y, z);
+                for (int k = grid.cellStart[n]; k < grid.cellStart[n + 1]; ++k) {
+                    size_t b = grid.cellBalls[k];
+                    // A pair of fast balls is tested from the one that moved further
+                    float moveB = world.sweepMove[b];
+                    if (b == a || moveB > moveA || (moveB == moveA && b < a))
+                        continue;
+                    Vec3 startB = stepStart(world, b);
+                    Vec3 d0 = startB - startA;
+                    Vec3 dd = (balls.position(b) - startB) - (endA - startA);
+                    float t = timeOfImpact(d0, dd, balls.radius[a] + balls.radius[b]);
+                    if (t >= 0 && (t < hitTime || (t == hitTime && b < hit))) {
+                        hitTime = t;
+                        hit = b;
+                    }
+                }
+            }
+    // Every world holding ball a finds the same impact; one of them resolves it
+    if (hit == a || !solvesPair(world, a, hit))
+        return;
+
+    size_t b = hit;
+    ++world.ccdHits;
+    bool sleepB = balls.sleeping[b];
+    Vec3 startB = stepStart(world, b);
+    Vec3 posA = startA + (endA - startA) * hitTime;
+    Vec3 posB = startB + (balls.position(b) - startB) * hitTime;
+    Vec3 normal = (posB - posA).normalized();
+    Vec3 velA = balls.velocity(a), velB = balls.velocity(b);
+    float velAlongNormal = (velB - velA).dot(normal);
+    world.sweepContacts.emplace_back(std::min(a, b), std::max(a, b));
+
+    if (velAlongNormal < 0) {
+        if (sleepB && -velAlongNormal > world.wakeSpeed) {
+            balls.wake(b);
+            sleepB = false;
+        }
+        float invMassA = balls.invMass[a];
+        float invMassB = sleepB ? 0.0f : balls.invMass[b];
+        float impulse = -(1 + bounceFactor(world, -velAlongNormal)) * velAlongNormal / (invMassA + invMassB);
+        velA = velA - normal * (impulse * invMassA);
+        velB += normal * (impulse * invMassB);
+        if (!sleepB)
+            spawnSparkExplosion(world, (posA + posB) * 0.5f, 15);
+    }
+
+    // Replay the rest of the step from the impact
+    float rest = (1 - hitTime) * dt;
+    balls.setVelocity(a, velA);
+    relocateSwept(world, a, posA + velA * rest);
+    if (!sleepB) {
+        balls.setVelocity(b, velB);
+        relocateSwept(world, b, posB + velB * rest);
+    }
+}
+
+// Mirrors the part of the step a ball spent beyond a wall back into the box
+static void sweepWalls(World& world, size_t i) {
+    BallSystem& balls = world.balls;
+    float inner = world.boxSize - balls.radius[i];
+    for (int j = 0; j < 3; ++j) {
+        float* coord = j == 0 ? &balls.px[i] : j == 1 ? &balls.py[i] : &balls.pz[i];
+        float* vel = j == 0 ? &balls.vx[i] : j == 1 ? &balls.vy[i] : &balls.vz[i];
+        float e = bounceFactor(world, std::fabs(*vel));
+        if (*coord < -inner) {
+            *coord = std::min(inner, -inner + (-inner - *coord) * e);
+            *vel *= -e;
+        }
+        else if (*coord > inner) {
+            *coord = std::max(-inner, inner - (*coord - inner) * e);
+            *vel *= -e;
+        }
+    }
+}
+
+void sweepFastBalls(World& world, float dt) {
+    BallSystem& balls = world.balls;
+    world.ccdSweeps = 0;
+    world.ccdHits = 0;
+    world.fastBalls.clear();
+    world.sweepContacts.clear();
+    if (!world.ccdEnabled || world.stepStartX.size() != balls.size())
+        return;
+
+    float slowMove = 0, maxRadius = 0;
+    world.sweepMove.assign(balls.size(), 0.0f);
+    world.sweepDrift.assign(balls.size(), 0.0f);
+    world.sweepMaxDrift = 0;
+    for (size_t i = 0; i < balls.size(); ++i) {
+        float move = (balls.position(i) - stepStart(world, i)).length();
+        maxRadius = std::max(maxRadius, balls.radius[i]);
+        if (move > balls.radius[i] * world.ccdThreshold) {
+            world.fastBalls.push_back(i);
+            world.sweepMove[i] = move;
+        }
+        else
+            slowMove = std::max(slowMove, move);
+    }
+    if (world.fastBalls.empty())
+        return;
+
+    // A ball that can meet the path of ball i, and moved no further than it,
+    // is filed within this reach of that path, even after earlier impacts
+    // moved it away from its cell
+    world.grid.build(balls, world.boxSize, world.gridRadius);
+    for (size_t i : world.fastBalls) {
+        float reach = balls.radius[i] + maxRadius + std::max({ world.sweepMove[i], slowMove, world.sweepMaxDrift });
+        sweepBall(world, i, reach, dt);
+        if (!isGhost(world, i))
+            sweepWalls(world, i);
+    }
+    world.ccdSweeps = world.fastBalls.size();
+}
+
+// ------------------ Sleeping -------------------
+void wakeAll(World& world) {
+    BallSystem& balls = world.balls;
+    std::fill(balls.sleeping.begin(), balls.sleeping.end(), 0);
+    std::fill(balls.restTime.begin(), balls.restTime.end(), 0.0f);
+    world.sleepingBalls = 0;
+}
+
+// Wakes everything when gravity, entropy or a force mode changed since the last step
+static void checkWakeEvents(World& world) {
+    WakeWatch now;
+    now.gravity = world.globalGravity;
+    now.entropy = world.entropyLevel;
+    now.blackHole = world.blackHoleMode;
+    now.cursor = world.cursorGravityMode;
+    now.magnetic = world.wallsAreMagnetic;
+    now.nbody = world.nbodyMode;
+    if (world.cursorGravityMode)
+        now.cursorTarget = world.cursorWorldTarget;
+
+    const WakeWatch& last = world.wakeWatch;
+    bool changed = now.gravity != last.gravity || now.entropy != last.entropy || now.blackHole != last.blackHole ||
+                   now.cursor != last.cursor || now.magnetic != last.magnetic || now.nbody != last.nbody ||
+                   now.cursorTarget.x != last.cursorTarget.x || now.cursorTarget.y != last.cursorTarget.y ||
+                   now.cursorTarget.z != last.cursorTarget.z;
+    if (changed || (!world.sleepEnabled && world.sleepingBalls > 0))
+        wakeAll(world);
+    world.wakeWatch = now;
+}
+
+static int findIsland(std::vector<int>& parent, int i) {
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+void updateSleep(World& world, float dt) {
+    if (!world.sleepEnabled)
+        return;
+    BallSystem& balls = world.balls;
+    size_t n = balls.size();
+
+    float speedSq = world.sleepSpeed * world.sleepSpeed;
+    world.pool.parallelFor(n, ballGrain, [&](size_t begin, size_t end, size_t) {
+        for (size_t i = begin; i < end; ++i) {
+            if (balls.sleeping[i])
+                continue;
+            float v2 = balls.vx[i] * balls.vx[i] + balls.vy[i] * balls.vy[i] + balls.vz[i] * balls.vz[i];
+            balls.restTime[i] = v2 < speedSq ? balls.restTime[i] + dt : 0.0f;
+        }
+    });
+
+    // Islands: balls joined by solver contacts or swept impacts. Contacts
+    // between two sleepers were never tested, so sleeping islands stay as they are.
+    std::vector<int>& parent = world.islandParent;
+    parent.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        parent[i] = static_cast<int>(i);
+    for (const std::vector<Contact>* list : { &world.contacts, &world.sweepContacts }) {
+        for (const Contact& c : *list) {
+            int ra = findIsland(parent, static_cast<int>(c.a));
+            int rb = findIsland(parent, static_cast<int>(c.b));
+            if (ra != rb)
+                parent[std::max(ra, rb)] = std::min(ra, rb);
+        }
+    }
+
+    // An island sleeps only when every awake ball in it has rested long enough
+    std::vector<uint8_t>& rests = world.islandRests;
+    rests.assign(n, 1);
+    for (size_t i = 0; i < n; ++i)
+        if (!balls.sleeping[i] && balls.restTime[i] < world.sleepDelay)
+            rests[findIsland(parent, static_cast<int>(i))] = 0;
+
+    size_t asleep = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!balls.sleeping[i] && rests[findIsland(parent, static_cast<int>(i))]) {
+            balls.sleeping[i] = 1;
+            balls.setVelocity(i, Vec3(0, 0, 0));
+        }
+        asleep += balls.sleeping[i];
+    }
+    world.sleepingBalls = asleep;
+}
+
+// ------------------ Simulation Update -------------------
+// This function is called every frame to update the simulation state
+void updateSimulation(World& world, float dt) {
+    if (world.paused)
+        return;
+
+    ProfileScope stepScope(world.profiler, PhaseStep);
+    world.sparks.beginStep();
+    checkWakeEvents(world);
+
+    if (world.blackHoleMode) {
+        BallSystem& balls = world.balls;
+        for (size_t i = 0; i < balls.size();) {
+            if (balls.position(i).length() < 1.0f) {
+                spawnSparkExplosion(world, balls.position(i), 20);
+                balls.remove(i);
+                continue;
+            }
+            ++i;
+        }
+    }
+
+    if (world.ccdEnabled) {
+        world.stepStartX = world.balls.px;
+        world.stepStartY = world.balls.py;
+        world.stepStartZ = world.balls.pz;
+    }
+    {
+        ProfileScope scope(world.profiler, PhaseIntegrate);
+        integrateBalls(world, dt);
+    }
+    if (world.exchange)
+        world.exchange->begin(world);
+    {
+        ProfileScope scope(world.profiler, PhaseCollisions);
+        sweepFastBalls(world, dt);
+        handleCollisions(world);
+    }
+    {
+        ProfileScope scope(world.profiler, PhaseSleep);
+        updateSleep(world, dt);
+    }
+    recordTrails(world);
+    {
+        ProfileScope scope(world.profiler, PhaseSparks);
+        world.sparks.update(dt, world.globalGravity);
+    }
+    ++world.stepCount;
+
+    if (world.profiler)
+        world.profiler->count(world.balls.size(), world.pairsTested, world.contacts.size(), world.sparks.size());
+}
@@ -0,0 +1,205 @@
+﻿#pragma once
+
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include "BallSystem.h"
+#include "BroadPhase.h"
+#include "Rng.h"
+#include "SimdKernel.h"
+#include "SparkPool.h"
+#include "Spawn.h"
+#include "Octree.h"
+#include "ThreadPool.h"
+#include "Vec3.h"
+
+struct ProfileRecorder;
+struct World;
+
+// Spark burst requested by a collision; spawned after the solve so that
+// parallel collision tasks never touch the spark pool
+struct SparkEvent {
+    Vec3 pos;
+    int count;
+};
+
+// Two touching balls, recorded by the collision solve for sleep islands and
+// stats. Contacts found by the overlap test also carry the solver state; a
+// contact with b == a is ball a against wall face `face`.
+struct Contact {
+    size_t a, b;
+    Vec3 normal;                  // unit, from a to b (or into the wall)
+    uint8_t face = 0;             // wall face: axis * 2, +1 for the positive side
+    float invMassA = 0, invMassB = 0;   // 0 for a sleeping ball
+    float target = 0;             // separating speed the solve aims for (restitution)
+    float impulse = 0;            // accumulated normal impulse, warm-started from the cache
+
+    Contact(size_t a, size_t b) : a(a), b(b) {}
+};
+
+// Normal impulse of a contact at the end of a step, keyed by the two ball ids
+struct CachedContact {
+    uint64_t key;
+    float impulse;
+};
+
+// Parameters whose change wakes every sleeping ball
+struct WakeWatch {
+    float gravity = 0, entropy = 0;
+    bool blackHole = false, cursor = false, magnetic = false, nbody = false;
+    Vec3 cursorTarget;
+};
+
+// What an exchange brings into agreement; see BallExchange
+enum ExchangeStage {
+    ExchangeCollisions,           // positions and velocities, before contact detection
+    ExchangeVelocities,           // after each colour of the warm start and of a velocity iteration
+    ExchangePositions,            // after each colour of a position pass
+};
+
+// Domain decomposition hook. Several worlds may hold copies of the same ball
+// (see World::ghosts); every pair is solved by exactly one world. begin() is
+// called once integration is done and again after clamping, and exchange() at
+// each stage of the collision solve, on every world the same number of times.
+// It carries what every world changed on each shared ball since the last call
+// to all copies, so the next colour sees the same state an undivided solve
+// would, and returns the largest `change` passed by any world, so that all of
+// them stop iterating together.
+class BallExchange {
+public:
+    virtual ~BallExchange() = default;
+    virtual void begin(World& world) = 0;
+    virtual float exchange(World& world, ExchangeStage stage, float change) = 0;
+};
+
+// ------------------ World -------------------
+// All simulation parameters and state. Nothing in here touches OpenGL, so a
+// World can be stepped by the GLUT front end or by a headless driver.
+struct World {
+    // Parameters
+    float boxSize = 10.0f;
+    float globalGravity = -9.8f;
+    float globalFriction = 0.1f;
+    float restitution = 0.9f;
+    float entropyLevel = 0.0f;
+    float timeScale = 1.0f;
+    bool paused = false;
+    bool wallsAreMagnetic = false;
+    bool blackHoleMode = false;
+    bool cursorGravityMode = false;
+    Vec3 cursorWorldTarget = Vec3(0, 0, 0);
+    bool nbodyMode = false;       // mutual ball-to-ball gravity
+    bool nbodyDirect = false;     // O(n^2) direct summation instead of Barnes-Hut
+    float nbodyTheta = 0.5f;      // Barnes-Hut opening angle; 0 opens every node
+    float nbodyG = 2.0f;
+    float nbodySoftening = 0.5f;  // keeps close encounters finite
+    bool sleepEnabled = true;     // put resting contact islands to sleep
+    float sleepSpeed = 0.5f;      // balls slower than this count as resting
+    float sleepDelay = 0.5f;      // seconds a whole island must rest before it sleeps
+    float wakeSpeed = 1.0f;       // impact speed at which an awake ball wakes a sleeper
+    int solverIterations = 8;     // most sequential-impulse iterations per step
+    float solverTolerance = 1e-3f;    // stop iterating once no contact changes speed by more than this
+    float bounceSpeed = 1.0f;     // closing speeds below this do not bounce, so stacks can settle
+    float penetrationSlop = 0.005f;   // overlap left alone by the position correction
+    bool warmStart = true;        // seed each contact with last step's impulse
+    bool ccdEnabled = true;       // sweep fast balls against balls and walls
+    float ccdThreshold = 0.5f;    // a ball is swept when it moves more than this fraction of its radius in a step
+
+    // Pool and broad phase configuration, applied by initWorld
+    uint64_t seed = 1;            // seeds every random draw the simulation makes
+    int sparkCapacity = 20000;    // most sparks alive at once
+    int sparkStepBudget = 2000;   // most sparks spawned in a single step
+    int trailInterval = 1;        // record a trail point every k steps; 0 = no trails
+    bool trailQuantized = false;  // store trail points as 16-bit fixed point
+    bool useSpatialHash = true;   // false = brute-force reference pair loop
+    int threadCount = 1;          // worker threads for integration and the grid collision solve
+    SimdLevel simdLevel = SimdAuto;   // integration kernel; SimdScalar is the reference path
+
+    // Domain decomposition: ghosts[i] marks ball i as a ghost, a copy of a
+    // ball another world owns; empty when there are none. The grid solve only
+    // takes the contacts of the cells whose centre lies in [cellsFrom,
+    // cellsTo) along x, and must hold every ball of those cells and of their
+    // neighbours; other worlds take the other cells. The reference pair loop
+    // and the sweep leave ghost pairs to the owners and solve a pair of a
+    // local ball and a ghost only when the local ball has the lower id. Either
+    // way every pair is solved in exactly one world.
+    std::vector<uint8_t> ghosts;
+    float cellsFrom = -FLT_MAX, cellsTo = FLT_MAX;
+    float gridRadius = 0.0f;      // the grid is sized for balls at least this large
+    BallExchange* exchange = nullptr;     // set by a domain slab; see BallExchange
+    ProfileRecorder* profiler = nullptr;  // times the step phases when set and enabled
+
+    // State
+    Rng rng;
+    RngStream spawnRng;           // colours and positions of spawned balls
+    RngStream sparkRng;           // spark directions and colours
+    uint64_t stepCount = 0;
+    SpawnParams startSpawn;       // layout of the starting balls, spawned again on reset
+    BallSystem balls;
+    SparkPool sparks;
+    SpatialGrid grid;
+    ThreadPool pool;
+    Octree octree;
+
+    // Per-chunk scratch for the parallel collision solve, reused every step
+    std::vector<std::vector<SparkEvent>> chunkSparks;
+    std::vector<size_t> chunkPairs;
+    std::vector<std::vector<Contact>> chunkContacts;
+
+    // Contacts of the last collision solve and the island scratch built from them.
+    // Contacts are grouped in batches; batches of one colour share no balls,
+    // so the solver runs them in parallel.
+    std::vector<Contact> contacts;
+    std::vector<size_t> batchStart;       // contacts of batch k are [batchStart[k], batchStart[k + 1])
+    std::vector<size_t> colorBatchStart;  // batches of colour c are [colorBatchStart[c], colorBatchStart[c + 1])
+    std::vector<float> batchChange;       // largest speed change in each batch during an iteration
+    std::vector<CachedContact> contactCache;  // sorted by key; impulses of the last step's contacts
+    std::vector<uint8_t> wallFaces;       // walls each ball was clamped against this step, one bit per face
+    std::vector<int> islandParent;
+    std::vector<uint8_t> islandRests;
+    WakeWatch wakeWatch;
+
+    // Positions at the start of the step and the balls fast enough to sweep
+    std::vector<float> stepStartX, stepStartY, stepStartZ;
+    std::vector<size_t> fastBalls;
+    std::vector<float> sweepMove;         // step displacement of each fast ball, 0 for the rest
+    std::vector<float> sweepDrift;        // bound on how far impacts moved each ball from its grid cell
+    float sweepMaxDrift = 0;              // largest sweepDrift so far this step
+    std::vector<Contact> sweepContacts;   // impacts found by the sweep; read only by the island builder
+
+    // Per-ball N-body accelerations, reused every step
+    std::vector<float> nbodyAx, nbodyAy, nbodyAz;
+
+    // Stats
+    size_t pairsTested = 0;       // candidate pairs tested in the last step
+    size_t sleepingBalls = 0;     // balls asleep after the last step
+    size_t ccdSweeps = 0;         // fast balls swept in the last step
+    size_t ccdHits = 0;           // impacts found by those sweeps
+    int solverIterationsUsed = 0; // iterations the last solve needed
+    float cacheHitRate = 0;       // share of the last step's contacts warm-started from the cache
+    float residualPenetration = 0;    // deepest overlap left after the last solve
+};
+
+// Applies the pool and thread configuration; call before spawning balls
+void initWorld(World& world);
+
+// Removes every ball along with the state kept about them: sparks, cached
+// contact impulses and step start positions
+void clearBalls(World& world);
+
+void spawnSparkExplosion(World& world, Vec3 position, int count = 10);
+void applyMutualGravity(World& world, float dt);
+void integrateBalls(World& world, float dt);
+void handleCollisions(World& world);
+// Time-of-impact pass for balls that moved too far this step to trust the overlap test
+void sweepFastBalls(World& world, float dt);
+void recordTrails(World& world);
+
+// Wakes every sleeping ball
+void wakeAll(World& world);
+// Updates rest timers, builds contact islands and puts fully resting islands to sleep
+void updateSleep(World& world, float dt);
+
+// Advances the whole world by dt (already scaled by timeScale)
+void updateSimulation(World& world, float dt);
@@ -0,0 +1,28 @@
+# Determinism.cmake : runs gravity_headless with every kernel level and
+# thread count and fails unless all final checksums match the scalar,
+# single-threaded run. Run with cmake -DHEADLESS=<path> -DARGS=<args> -P.
+# Levels the CPU lacks fall back to the widest supported one.
+
+separate_arguments(ARGS)
+
+set(reference "")
+foreach(simd scalar sse2 avx2)
+    foreach(threads 1 4)
+        execute_process(COMMAND ${HEADLESS} ${ARGS} --simd ${simd} --threads ${threads}
+                        OUTPUT_VARIABLE out RESULT_VARIABLE rc)
+        if(NOT rc EQUAL 0)
+            message(FATAL_ERROR "gravity_headless --simd ${simd} --threads ${threads} failed (${rc})")
+        endif()
+        string(REGEX MATCH "checksum: *([0-9a-f]+)" found "${out}")
+        set(sum "${CMAKE_MATCH_1}")
+        if(sum STREQUAL "")
+            message(FATAL_ERROR "no checksum in the output of --simd ${simd} --threads ${threads}")
+        endif()
+        message(STATUS "${simd}, ${threads} threads: ${sum}")
+        if(reference STREQUAL "")
+            set(reference "${sum}")
+        elseif(NOT sum STREQUAL reference)
+            message(FATAL_ERROR "checksum ${sum} (${simd}, ${threads} threads) differs from ${reference} (scalar, 1 thread)")
+        endif()
+    endforeach()
+endforeach()
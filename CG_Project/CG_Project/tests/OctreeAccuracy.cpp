@@ -0,0 +1,55 @@
+﻿// OctreeAccuracy.cpp : Checks Barnes-Hut accelerations against direct summation.
+//
+// Spawns a seeded world, builds the octree and compares the acceleration of
+// evenly spaced sample balls with directAcceleration. Fails when the mean or
+// the worst relative error at the default opening angle exceeds its bound,
+// or when theta = 0 (every node opened) is not exact to rounding.
+
+#include <algorithm>
+#include <iostream>
+
+#include "Spawn.h"
+#include "World.h"
+
+static const size_t ballCount = 5000;
+static const size_t samples = 500;
+static const double meanBound = 0.01;     // theta 0.5
+static const double worstBound = 0.10;
+static const double exactBound = 1e-4;    // theta 0: float summation order only
+
+// Mean and worst relative error over the samples
+static void measure(const World& world, float theta, double& mean, double& worst) {
+    const BallSystem& balls = world.balls;
+    double sum = 0;
+    worst = 0;
+    for (size_t s = 0; s < samples; ++s) {
+        size_t i = s * balls.size() / samples;
+        Vec3 a = world.octree.acceleration(balls, i, theta, world.nbodyG, world.nbodySoftening);
+        Vec3 d = directAcceleration(balls, i, world.nbodyG, world.nbodySoftening);
+        double err = d.length() > 0 ? (a - d).length() / d.length() : 0;
+        sum += err;
+        worst = std::max(worst, err);
+    }
+    mean = sum / samples;
+}
+
+int main() {
+    World world;
+    SpawnParams spawn;
+    spawn.count = ballCount;
+    world.boxSize = std::max(world.boxSize, spawnBoxSize(ballCount, spawn));
+    initWorld(world);
+    spawnBalls(world, spawn);
+    world.octree.build(world.balls, world.boxSize, world.pool);
+
+    double mean, worst, exactMean, exactWorst;
+    measure(world, world.nbodyTheta, mean, worst);
+    measure(world, 0.0f, exactMean, exactWorst);
+    std::cout << "theta " << world.nbodyTheta << ": mean " << mean << ", worst " << worst << "\n";
+    std::cout << "theta 0: worst " << exactWorst << "\n";
+
+    bool ok = mean <= meanBound && worst <= worstBound && exactWorst <= exactBound;
+    if (!ok)
+        std::cerr << "octree error above bound (mean " << meanBound << ", worst " << worstBound << ", exact " << exactBound << ")\n";
+    return ok ? 0 : 1;
+}